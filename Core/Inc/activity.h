@@ -0,0 +1,64 @@
+#ifndef ACTIVITY_H
+#define ACTIVITY_H
+
+#include "main.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Typedefs */
+
+/** Activity statistics
+ *
+ * wakes: Times the core started running out of sleep.
+ * active_us: Time the core was running.
+ * elapsed_us: Time the statistics cover.
+ */
+typedef struct
+{
+	uint32_t wakes;
+	uint32_t active_us;
+	uint32_t elapsed_us;
+} activity_stats_t;
+
+/* Public Functions */
+
+/** Starts counting activity, with the caller counted as running.
+ *
+ * Must be called once, after initialize_timestamp().
+ */
+void initialize_activity();
+
+/** Marks the start of a run of code, at the top of every interrupt handler
+ * and where the core wakes from sleep.
+ *
+ * Safe to nest. Only the outermost call counts as a wake, so handlers that
+ * tail-chain without the core sleeping in between count as one wake each.
+ */
+void enter_activity();
+
+/** Called by enter_activity() whenever the core wakes, before the handler
+ * that woke it goes on.
+ *
+ * Does nothing unless overridden. Runs with interrupts masked, so an
+ * override should only catch up clocks that stopped in sleep.
+ */
+void activity_wake_callback();
+
+/** Marks the end of a run started by enter_activity(), at the end of every
+ * interrupt handler and right before the core sleeps.
+ */
+void exit_activity();
+
+/** Reads the statistics since the last call and starts over.
+ *
+ * @params stats Filled with the statistics.
+ */
+void read_activity(activity_stats_t* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,142 @@
+#ifndef ALERT_PIPELINE_H
+#define ALERT_PIPELINE_H
+
+#include "main.h"
+#include "state_machine.h"
+
+/* Defines */
+
+/** Echo-driven alert pipeline.
+ *
+ * When enabled, every published echo pends PendSV, and its handler filters
+ * and tracks the new samples and updates the alert state machine right
+ * away. The LEDs then follow an echo within microseconds instead of waiting
+ * for the main loop. When disabled, request_alert_pipeline() runs the
+ * pipeline in the caller instead.
+ *
+ * Not available with ULTRASOUND_POLLED_CAPTURE, where nothing is published
+ * until a reader polls.
+ */
+#define ALERT_PIPELINE_PENDSV 1
+
+/* PendSV priority, below capture so echoes are never held up, above the tasks */
+#define ALERT_PIPELINE_PENDSV_PRIORITY PROCESSING_IRQ_PRIORITY
+
+/* Alert changes buffered until read out, a power of two */
+#define ALERT_PIPELINE_EVENT_QUEUE_SIZE 8
+
+/* Telemetry records buffered until read out, a power of two */
+#define ALERT_PIPELINE_TELEMETRY_QUEUE_SIZE 32
+
+/* Typedefs */
+
+/** Alert pipeline status
+ *
+ * A snapshot of the last pipeline run for reporting. sequence counts the
+ * changes published, lost_sensors has bit n set while sensor n is lost.
+ * The drop counts are events and telemetry records lost to full queues.
+ */
+typedef struct
+{
+	uint32_t sequence;
+	state_machine_state_enum_t state;
+	int32_t distance_mm;
+	uint8_t nearest_sensor;
+	uint8_t lost_sensors;
+	uint32_t latency_us;
+	uint32_t max_latency_us;
+	uint32_t max_filter_cycles;
+	uint32_t max_update_cycles;
+	uint32_t event_drops;
+	uint32_t telemetry_drops;
+} alert_pipeline_status_t;
+
+/** Alert pipeline event
+ *
+ * An alert state change and the sample that caused it.
+ */
+typedef struct
+{
+	uint64_t timestamp_us;
+	int32_t distance_mm;
+	uint8_t sensor;
+	uint8_t from;
+	uint8_t to;
+} alert_pipeline_event_t;
+
+/** Alert pipeline telemetry record
+ *
+ * One state machine update: the sample time, the signals it ran on, the
+ * resulting state, and the time from the echo to the state machine having
+ * acted.
+ */
+typedef struct
+{
+	uint64_t timestamp_us;
+	int32_t distance_mm;
+	int32_t rate_mm_s;
+	uint32_t latency_us;
+	uint32_t update_cycles;
+	uint8_t sensor;
+	uint8_t state;
+} alert_pipeline_telemetry_t;
+
+/* Public Functions */
+
+/** Initializes the filters, trackers and alert state machine.
+ *
+ * Call before the ultrasound is enabled, the first echo pends PendSV and
+ * runs the pipeline. Also sets the PendSV priority. The initial state's
+ * ping rate is applied when the ultrasound is enabled.
+ */
+void initialize_alert_pipeline();
+
+/** Runs the pipeline over every sample published since the last run.
+ *
+ * Every sample updates the state machine in the order it was published.
+ * While any sensor is lost, every run also updates it once more, so the
+ * alert follows a dropout even with no echo arriving.
+ *
+ * This is the PendSV handler body. Must not be interrupted by another call
+ * to itself.
+ */
+void run_alert_pipeline();
+
+/** Requests a pipeline run even without a new echo.
+ *
+ * Sensors that stopped echoing are only noticed as lost when the pipeline
+ * runs, so this should be called periodically.
+ */
+void request_alert_pipeline();
+
+/** Gets the status of the last pipeline run if it is newer than the given sequence.
+ *
+ * Safe to call while the pipeline runs; the copy is never a mix of two runs.
+ *
+ * @params status Filled with the latest status if it is new.
+ * @params last_sequence The sequence of the last status the caller handled.
+ * @returns 1 if a new status was copied, otherwise 0.
+ */
+uint8_t get_alert_pipeline_status(alert_pipeline_status_t* status, uint32_t last_sequence);
+
+/** Reads out every alert change since the last call, oldest first.
+ *
+ * Only one context may read the events.
+ *
+ * @params events Buffer to fill with events.
+ * @params max_events Size of the buffer.
+ * @returns The number of events written to the buffer.
+ */
+uint32_t read_alert_pipeline_events(alert_pipeline_event_t* events, uint32_t max_events);
+
+/** Reads out every telemetry record since the last call, oldest first.
+ *
+ * Only one context may read the records.
+ *
+ * @params records Buffer to fill with records.
+ * @params max_records Size of the buffer.
+ * @returns The number of records written to the buffer.
+ */
+uint32_t read_alert_pipeline_telemetry(alert_pipeline_telemetry_t* records, uint32_t max_records);
+
+#endif
@@ -68,6 +68,27 @@ void Error_Handler(void);
 #define GREEN_LED_GPIO_Port GPIOE
 /* USER CODE BEGIN Private defines */
 
+/** Interrupt-driven build.
+ *
+ * When enabled, main() only initializes the peripherals, sets SLEEPONEXIT
+ * and sleeps, so the core never returns to thread mode. Capture, the alert
+ * pipeline, the alert outputs and the reporting all run as interrupt
+ * handlers at the priorities below, and the core sleeps as soon as the
+ * last one returns. When disabled, the scheduler runs the tasks from the
+ * main loop.
+ */
+#define INTERRUPT_DRIVEN_MODE 0
+
+/* NVIC preemption priorities, lower values preempt higher ones */
+/* Echo capture DMA and the capture and trigger timers */
+#define ACQUISITION_IRQ_PRIORITY 0
+/* Alert pipeline on PendSV, filters and acts on every echo */
+#define PROCESSING_IRQ_PRIORITY 4
+/* Scheduler tasks on TIM6, alert flashing and reporting */
+#define TASK_IRQ_PRIORITY 8
+/* UART transmit DMA and completion, chaining the queued telemetry */
+#define TELEMETRY_IRQ_PRIORITY 12
+
 /* USER CODE END Private defines */
 
 #ifdef __cplusplus
@@ -0,0 +1,66 @@
+#ifndef RANGE_FILTER_H
+#define RANGE_FILTER_H
+
+#include "main.h"
+
+/* Defines */
+
+/* Filter modes, see RANGE_FILTER_MODE */
+#define RANGE_FILTER_MEDIAN 0
+#define RANGE_FILTER_HAMPEL 1
+
+/** Range filter mode.
+ *
+ * MEDIAN: Outputs the median of the last RANGE_FILTER_WINDOW samples.
+ * HAMPEL: Outputs the newest sample, unless it is further than
+ * RANGE_FILTER_HAMPEL_MADS scaled median absolute deviations from the
+ * window median, in which case the median replaces it. Clean samples pass
+ * through without the median's delay.
+ */
+#define RANGE_FILTER_MODE RANGE_FILTER_HAMPEL
+
+/* Samples in the filter window, 3 or 5 */
+#define RANGE_FILTER_WINDOW 5
+
+/* Outlier threshold in scaled median absolute deviations */
+#define RANGE_FILTER_HAMPEL_MADS 3
+
+/* Smallest outlier threshold in mm, for a window with no deviation at all */
+#define RANGE_FILTER_HAMPEL_MIN_MM 10
+
+/* Typedefs */
+
+/** Range filter
+ *
+ * Holds the sample window of a single sensor, plus the cycle cost of the
+ * last and the slowest update.
+ */
+typedef struct
+{
+	int32_t window[RANGE_FILTER_WINDOW];
+	uint8_t next;
+	uint8_t count;
+	uint32_t last_cycles;
+	uint32_t max_cycles;
+} range_filter_t;
+
+/* Public Functions */
+
+/** Empties the filter window.
+ *
+ * @params filter The filter to reset.
+ */
+void initialize_range_filter(range_filter_t* filter);
+
+/** Adds a sample to the filter and gets the filtered distance.
+ *
+ * Constant time: the median is a fixed sorting network over the window. The
+ * first samples pass through until the window is full.
+ *
+ * @params filter The filter to update.
+ * @params distance_mm The new distance.
+ * @returns The filtered distance in mm.
+ */
+int32_t update_range_filter(range_filter_t* filter, int32_t distance_mm);
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef RANGE_TRACKER_H
+#define RANGE_TRACKER_H
+
+#include "main.h"
+
+/* Defines */
+
+/* Range gain of the alpha-beta tracker, Q16 */
+#define RANGE_TRACKER_ALPHA_Q16 32768
+
+/* Range-rate gain of the alpha-beta tracker, Q16 */
+#define RANGE_TRACKER_BETA_Q16 6554
+
+/* Gap in us between samples after which the track starts over */
+#define RANGE_TRACKER_MAX_GAP_US 200000
+
+/* Time to collision reported while the object is not closing in */
+#define RANGE_TRACKER_NO_COLLISION UINT32_MAX
+
+/* Typedefs */
+
+/** Range tracker
+ *
+ * Alpha-beta estimate for a single sensor. The range is kept in um so the
+ * gains keep their precision, the range-rate is in mm/s (um/ms) and is
+ * negative while the object closes in.
+ */
+typedef struct
+{
+	int32_t range_um;
+	int32_t rate_mm_s;
+	uint32_t time_to_collision_ms;
+	uint64_t last_timestamp_us;
+	uint8_t is_tracking;
+} range_tracker_t;
+
+/* Public Functions */
+
+/** Drops the current track.
+ *
+ * @params tracker The tracker to reset.
+ */
+void initialize_range_tracker(range_tracker_t* tracker);
+
+/** Updates the track with a new measured range.
+ *
+ * Constant time and integer only, with no 64 bit division.
+ *
+ * @params tracker The tracker to update.
+ * @params distance_mm The measured range.
+ * @params timestamp_us The time the range was measured.
+ */
+void update_range_tracker(
+	range_tracker_t* tracker,
+	int32_t distance_mm,
+	uint64_t timestamp_us
+);
+
+/** Gets the range the tracked object will be at after a lead time.
+ *
+ * Fed to the state machine instead of the measured range, this makes an
+ * alert fire the lead time earlier for an object closing in, and not at
+ * all earlier for one standing still.
+ *
+ * @params tracker The tracker to read.
+ * @params lead_ms The time to look ahead.
+ * @returns The predicted range in mm, never below 0.
+ */
+int32_t get_range_tracker_lead_mm(const range_tracker_t* tracker, uint32_t lead_ms);
+
+#endif
@@ -0,0 +1,131 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include "main.h"
+
+/* Defines */
+
+/* Most tasks the scheduler holds */
+#define SCHEDULER_MAX_TASKS 8
+
+/* Returned by add_scheduler_task() when no task could be added */
+#define SCHEDULER_NO_TASK 0xFF
+
+/* Period of a task that only runs when signalled */
+#define SCHEDULER_EVENT_TASK 0
+
+/* Deadline of a periodic task that is due by its next release */
+#define SCHEDULER_PERIOD_DEADLINE 0
+
+/** Tickless sleep.
+ *
+ * When enabled, SysTick is suspended while the scheduler sleeps, so the
+ * core only wakes for the next task release or an interrupt instead of
+ * every millisecond. TIM6 times the sleep and the HAL tick and timestamp
+ * clock are caught up on wake-up.
+ */
+#define SCHEDULER_TICKLESS 1
+
+/* Shortest time in us until the next release worth sleeping for */
+#define SCHEDULER_MIN_SLEEP_US 50
+
+/* Longest sleep in us, the range of the 16 bit TIM6 counting microseconds */
+#define SCHEDULER_MAX_SLEEP_US 65535
+
+/* Typedefs */
+
+/* Task function type, runs to completion */
+typedef void (*scheduler_task_func_t) (void);
+
+/** Scheduler task statistics
+ *
+ * runs: Number of times the task ran.
+ * deadline_misses: Runs that finished after their deadline, plus periodic
+ * releases skipped because the task was still late.
+ * last_cycles, max_cycles: Cycles of the last and the slowest run.
+ * total_cycles: Cycles of every run, to work out the task's CPU share.
+ */
+typedef struct
+{
+	uint32_t runs;
+	uint32_t deadline_misses;
+	uint32_t last_cycles;
+	uint32_t max_cycles;
+	uint64_t total_cycles;
+} scheduler_task_stats_t;
+
+/* Public Functions */
+
+/** Sets up the scheduler with no tasks.
+ *
+ * Must be called once, after initialize_timestamp().
+ */
+void initialize_scheduler();
+
+/** Adds a task to the scheduler.
+ *
+ * Tasks run to completion, the ready task with the lowest priority value
+ * first and the earliest deadline among equals. A periodic task is first
+ * released one period after it is added. Too many tasks, and event tasks
+ * without a deadline of their own, are reported through Error_Handler().
+ *
+ * @params func The task function.
+ * @params period_us Time between releases, or SCHEDULER_EVENT_TASK.
+ * @params deadline_us Time from a release or signal the run must finish by,
+ * or SCHEDULER_PERIOD_DEADLINE for periodic tasks.
+ * @params priority Lower values run first.
+ * @returns The task, or SCHEDULER_NO_TASK.
+ */
+uint8_t add_scheduler_task(
+	scheduler_task_func_t func,
+	uint32_t period_us,
+	uint32_t deadline_us,
+	uint8_t priority
+);
+
+/** Releases a task to run once.
+ *
+ * Safe to call from any interrupt. Signalling a task that has not run yet
+ * since the last signal has no further effect. A periodic task keeps its
+ * release times, the signal adds a run that also serves a release already
+ * due, and the run's deadline counts from the earlier of the two.
+ *
+ * @params task The task to release.
+ */
+void signal_scheduler_task(uint8_t task);
+
+/** Runs the tasks forever, sleeping in WFI while none is ready. */
+void run_scheduler();
+
+/** Hands the tasks over to the TIM6 interrupt, in place of run_scheduler().
+ *
+ * For INTERRUPT_DRIVEN_MODE. The tasks then run in dispatch_scheduler() at
+ * TASK_IRQ_PRIORITY, and the caller may put the core to sleep for good.
+ * When tickless, SysTick stays off and the HAL tick follows the timestamp
+ * clock, which TIM6 reads at least every SCHEDULER_MAX_SLEEP_US. The cycle
+ * counter behind the timestamp stops while the core sleeps, so the
+ * scheduler overrides activity_wake_callback() to catch it up on TIM6
+ * at every wake.
+ */
+void start_scheduler();
+
+/** Runs every ready task, then sets TIM6 to fire at the next release.
+ *
+ * Called from the TIM6 interrupt after start_scheduler().
+ */
+void dispatch_scheduler();
+
+/** Gets the statistics of a task.
+ *
+ * @params task The task to read.
+ * @params stats Filled with the statistics.
+ */
+void get_scheduler_task_stats(uint8_t task, scheduler_task_stats_t* stats);
+
+/** Gets the number of tasks added.
+ *
+ * @returns The task count.
+ */
+uint8_t get_scheduler_task_count();
+
+#endif
@@ -0,0 +1,85 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include "main.h"
+
+/* Defines */
+
+/* Checks at compile time that a ring capacity is a power of two */
+#define SPSC_RING_IS_POWER_OF_TWO(capacity) \
+	((capacity) != 0 && ((capacity) & ((capacity) - 1)) == 0)
+
+/* Typedefs */
+
+/** Single-producer single-consumer ring
+ *
+ * Hands fixed size elements from one context to another, typically from an
+ * interrupt to thread mode, without any critical section. The head is only
+ * written by the producer and the tail only by the consumer. Both run
+ * freely and wrap through the power of two capacity with a mask.
+ *
+ * A full ring drops the new element and counts it, so the oldest elements
+ * are never overwritten under the consumer. Several producers or consumers
+ * may share a ring only if they never preempt one another.
+ */
+typedef struct
+{
+	uint8_t* buffer;
+	uint32_t element_size;
+	uint32_t mask;
+	volatile uint32_t head;
+	volatile uint32_t tail;
+	volatile uint32_t drops;
+} spsc_ring_t;
+
+/* Public Functions */
+
+/** Sets up an empty ring over the given storage.
+ *
+ * A capacity that is not a power of two is reported through
+ * Error_Handler().
+ *
+ * @params ring The ring to set up.
+ * @params buffer Storage for capacity elements.
+ * @params element_size Size of an element in bytes.
+ * @params capacity Number of elements, a power of two.
+ */
+void initialize_spsc_ring(
+	spsc_ring_t* ring,
+	void* buffer,
+	uint32_t element_size,
+	uint32_t capacity
+);
+
+/** Adds an element, only to be called by the producer.
+ *
+ * @params ring The ring to add to.
+ * @params element The element to copy in.
+ * @returns 1 if the element was added, 0 if the ring was full.
+ */
+uint8_t push_spsc_ring(spsc_ring_t* ring, const void* element);
+
+/** Takes out the oldest element, only to be called by the consumer.
+ *
+ * @params ring The ring to take from.
+ * @params element Filled with the element.
+ * @returns 1 if an element was taken, 0 if the ring was empty.
+ */
+uint8_t pop_spsc_ring(spsc_ring_t* ring, void* element);
+
+/** Gets the number of elements waiting.
+ *
+ * @params ring The ring to check.
+ * @returns The element count, exact for the consumer and a lower bound
+ * of the free space for the producer.
+ */
+uint32_t get_spsc_ring_count(const spsc_ring_t* ring);
+
+/** Gets the number of elements dropped because the ring was full.
+ *
+ * @params ring The ring to check.
+ * @returns The drop count since the ring was set up.
+ */
+uint32_t get_spsc_ring_drops(const spsc_ring_t* ring);
+
+#endif
@@ -4,11 +4,58 @@
 /* Includes */
 #include "main.h"
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 /* Defines */
 
+/* Number of signals every state machine update carries */
+#define STATE_MACHINE_SIGNAL_COUNT 5
+
+/** Band lookup table.
+ *
+ * When enabled, the first initialize_state_machine() of a configuration
+ * compiles the transitions into a table indexed by the current state, the state the hysteresis returns to
+ * and the band the signal falls in. Finding the next state is then a single
+ * table read instead of checking every transition in turn.
+ *
+ * This only works when the first guard of every transition is a threshold
+ * (<, >, <=, >=) on one and the same signal. Second guards are still checked
+ * where the table cannot settle them. Any other machine, a hierarchical one,
+ * or one that needs more states or bands than below, falls back to checking
+ * the transitions.
+ */
+#define STATE_MACHINE_BAND_LUT 1
+
+/* Most states and signal bands the lookup table has room for */
+#define STATE_MACHINE_LUT_MAX_STATES 6
+#define STATE_MACHINE_LUT_MAX_BANDS 24
+
+/* Most states a hierarchical state machine may have */
+#define STATE_MACHINE_MAX_STATES 16
+
+/* Deepest nesting of hierarchical states, the innermost state included */
+#define STATE_MACHINE_MAX_DEPTH 4
+
 /* Value for disabled hysteresis */
 #define HYSTERESIS_DISABLED 0
 
+/* Transition hysteresis that defers to the configuration's hysteresis, kept
+ * apart from HYSTERESIS_DISABLED so a transition can opt out on its own */
+#define STATE_MACHINE_CONFIG_HYSTERESIS UINT32_MAX
+
+/** Dwell of a transition.
+ *
+ * A transition with a dwell only fires once it held on N consecutive
+ * updates, or on every update for T microseconds of parameter time. A dwell
+ * of 0 fires on the first update that holds, as do 0 and 1 samples.
+ */
+#define STATE_MACHINE_NO_DWELL 0
+#define STATE_MACHINE_DWELL_US_FLAG 0x80000000
+#define STATE_MACHINE_DWELL_SAMPLES(samples) ((uint32_t)(samples))
+#define STATE_MACHINE_DWELL_US(time_us) ((uint32_t)(time_us) | STATE_MACHINE_DWELL_US_FLAG)
+
 /* The initial state for any state machine should be 0. */
 #define INITIAL_STATE 0
 
@@ -20,8 +67,17 @@
  */
 #define INVALID_STATE -1
 
+/* A guard comparing a signal against a threshold */
+#define STATE_MACHINE_GUARD(signal, type, threshold) \
+	{ (threshold), (signal), (type) }
+
+/* Fills the unused second guard of a single guard transition */
+#define STATE_MACHINE_NO_GUARD STATE_MACHINE_GUARD(0, EMPTY, 0)
+
 #define STATE_MACHINE_TRANSITION_TERMINATOR_DECL \
-	{ {INVALID_STATE}, EMPTY, 0, STATE_MACHINE_NO_FUNC}
+	{ {STATE_MACHINE_NO_GUARD, STATE_MACHINE_NO_GUARD}, GUARD_SINGLE, \
+		INVALID_STATE, STATE_MACHINE_NO_FUNC, HYSTERESIS_DISABLED, \
+		STATE_MACHINE_NO_DWELL }
 
 /* Typedefs */
 
@@ -41,16 +97,31 @@ typedef enum
 	EMPTY
 } transition_type_t;
 
+/** Guard combinations
+ *
+ * Used to define how the two guards of a transition combine.
+ *
+ * SINGLE: Only the first guard is checked.
+ * AND: Both guards must hold.
+ * OR: Either guard must hold.
+ */
+typedef enum
+{
+	GUARD_SINGLE,
+	GUARD_AND,
+	GUARD_OR
+} guard_combination_t;
+
 /** Transition function type
  *
  * All transitions should not return anything and should accept no arguments.
+ * Only called when the transition is taken.
  */
 typedef void (*transition_func_t) (void);
 
 /** State machine function type
  *
- * Useful for when a state has an internal looping function.
- * Called on every update.
+ * Used for the enter, exit and tick hooks of a state.
  */
 typedef void (*state_machine_func_t) (void);
 
@@ -62,73 +133,296 @@ typedef void (*state_machine_func_t) (void);
  */
 typedef int32_t state_machine_state_enum_t;
 
-/** State machine parameter
+/** State machine signal type
  *
- * This state machine currently only accepts a
- * single, continuous variable as a parameter.
+ * Index of a signal in the state machine parameters. The meaning of each
+ * signal is up to the state machine configuration.
+ */
+typedef uint8_t state_machine_signal_t;
+
+/** State machine parameters
+ *
+ * A fixed vector of continuous signals, such as a distance and a velocity,
+ * all updated together, and the time in us they were measured at. The time
+ * is only used for dwells given in microseconds.
  */
 typedef struct
 {
-	int32_t distance;
+	int32_t signals[STATE_MACHINE_SIGNAL_COUNT];
+	uint64_t timestamp_us;
 } state_machine_params_t;
 
+/** State machine guard struct
+ *
+ * Compares a single signal against a threshold. Packed into 8 bytes.
+ */
+typedef struct
+{
+	int32_t threshold;
+	state_machine_signal_t signal;
+	uint8_t type;
+} state_machine_guard_t;
+
 /** State machine transition struct
  *
- * Contains information about a specific transition.
+ * Contains information about a specific transition. The transition is
+ * taken when its guards, combined as given, hold.
+ *
+ * Hysteresis only ever applies to the signal of the first guard.
+ *
+ * hysteresis: How far the thresholds move while the transition leads back to
+ * the state just left, HYSTERESIS_DISABLED for none or
+ * STATE_MACHINE_CONFIG_HYSTERESIS for the configuration's. A transition that
+ * leaves it out has none. The hysteresis is released with the value of the
+ * transition that was taken, so both directions across a band should use the
+ * same value.
+ * dwell: How long the transition has to hold before it fires, see
+ * STATE_MACHINE_DWELL_SAMPLES() and STATE_MACHINE_DWELL_US().
  */
 typedef struct
 {
-	state_machine_params_t threshold;
-	transition_type_t type;
+	state_machine_guard_t guards[2];
+	guard_combination_t combination;
 	state_machine_state_enum_t next_state;
 	transition_func_t transition_func;
+	uint32_t hysteresis;
+	uint32_t dwell;
 } state_machine_transition_t;
 
 /** State machine states struct
  *
- * Holds information about the state, its execution function,
+ * Holds information about the state, its hooks,
  * and the available transitions for that state.
+ *
+ * parent: The state whose transitions also apply to this one, or NULL at the
+ * top level. A state's own transitions are checked before its parent's, so
+ * children can override what they share. The parent is active along with
+ * any of its children.
+ * on_enter: Called once when the state is entered, and for the initial state
+ * by initialize_state_machine(). Parents are entered before their children.
+ * on_exit: Called once when the state is left, before the transition function.
+ * Children are left before their parents. Parents shared by the old and new
+ * state are neither left nor entered.
+ * on_tick: Called on every update that ends in this state or in one of its
+ * children, for states with an internal looping function.
+ *
+ * Any hook may be NULL. Peripheral writes belong in on_enter and on_exit, so
+ * an update without a transition does no more than check the guards.
+ *
+ * States should be defined const, so they stay in flash. The engine only
+ * ever reads them through const pointers and never copies them.
  */
-typedef struct
+typedef struct state_machine_state_s
 {
 	state_machine_state_enum_t state;
-	state_machine_func_t state_execution;
+	const struct state_machine_state_s* parent;
+	state_machine_func_t on_enter;
+	state_machine_func_t on_exit;
+	state_machine_func_t on_tick;
 	state_machine_transition_t transitions[];
 } state_machine_state_t;
 
+/** State machine band lookup table
+ *
+ * The signal is cut into bands at every threshold, with and without the
+ * hysteresis. Every threshold lies on a grid of the band width starting at
+ * the base, so no transition can change its mind within a band. Band 0 holds
+ * everything below the base and the last band everything above the top.
+ *
+ * Every entry holds the index of the first transition that holds, flagged as
+ * such, or of the first one whose second guard has to be checked.
+ *
+ * Filled in by the first initialize_state_machine() of its configuration,
+ * so it has to live in RAM and start zeroed. All instances of one
+ * configuration share its table, later instances never write it again,
+ * since an instance already running may be reading it.
+ */
+typedef struct
+{
+	uint8_t is_compiled;
+	uint8_t is_active;
+	state_machine_signal_t signal;
+	int32_t base;
+	uint32_t width;
+	uint32_t band_count;
+	uint8_t entries[STATE_MACHINE_LUT_MAX_STATES][STATE_MACHINE_LUT_MAX_STATES + 1]
+		[STATE_MACHINE_LUT_MAX_BANDS];
+} state_machine_band_lut_t;
+
+/** State machine hierarchy
+ *
+ * Every state followed by its ancestors, innermost first, so neither updates
+ * nor state changes ever follow the parent pointers.
+ *
+ * Filled in by the first initialize_state_machine() of its configuration
+ * that succeeds, so it has to live in RAM and start zeroed. All instances
+ * of one configuration share its hierarchy, later instances never write it
+ * again.
+ */
+typedef struct
+{
+	uint8_t is_compiled;
+	uint8_t depths[STATE_MACHINE_MAX_STATES];
+	const state_machine_state_t* chains[STATE_MACHINE_MAX_STATES][STATE_MACHINE_MAX_DEPTH];
+} state_machine_hierarchy_t;
+
+/** State machine dispatch function type
+ *
+ * Finds the first transition of a state, or of its ancestors, that holds.
+ * Generated by Tools/state_machine_compiler.py with every guard compared
+ * inline, instead of checking the transitions in turn.
+ *
+ * @params state The current state.
+ * @params returning_state The state the hysteresis returns to.
+ * @params hysteresis_signal The signal the hysteresis applies to.
+ * @params params The update parameters.
+ * @returns The transition that holds, or NULL if none does.
+ */
+typedef const state_machine_transition_t* (*state_machine_dispatch_func_t) (
+	state_machine_state_enum_t state,
+	state_machine_state_enum_t returning_state,
+	state_machine_signal_t hysteresis_signal,
+	const state_machine_params_t* params
+);
+
 /** State machine configuration struct
  *
  * Contains the configuration information
  * required for the state machine to operate.
+ *
+ * band_lut may be NULL to always check the transitions in turn.
+ * hierarchy must be given if any state has a parent, otherwise NULL.
+ * dispatch may be NULL, otherwise it replaces both the transition checks
+ * and the band lookup table.
  */
 typedef struct
 {
 	uint32_t hysteresis;
-	state_machine_state_t** state_machine;
+	const state_machine_state_t* const* state_machine;
+	state_machine_band_lut_t* band_lut;
+	state_machine_hierarchy_t* hierarchy;
+	state_machine_dispatch_func_t dispatch;
 } state_machine_config_t;
 
+/** State machine instance
+ *
+ * Holds everything a single running state machine keeps between updates,
+ * 32 bytes in all. The configuration, states and lookup table are only
+ * referenced, so any number of instances can run the same configuration.
+ *
+ * Instances must start zeroed and are only changed through the functions
+ * below.
+ */
+typedef struct
+{
+	const state_machine_config_t* config;
+	const state_machine_state_t* current_state;
+	const state_machine_state_t* previous_state;
+	const state_machine_transition_t* triggered_transition;
+	state_machine_state_enum_t returning_state;
+	const state_machine_transition_t* pending_transition;
+	uint64_t pending_dwell;
+} state_machine_t;
+
+/** Batch update actions
+ *
+ * How update_state_machine_batch() runs the hooks and transition functions.
+ *
+ * IMMEDIATE: Every sample runs them just like update_state_machine().
+ * DEFERRED: None run during the batch. Afterwards the transitions taken run
+ * theirs in order, then the final state ticks once.
+ * COALESCED: None run during the batch. Afterwards only the net change from
+ * the first to the final state is left and entered, without transition
+ * functions, then the final state ticks once.
+ */
+typedef enum
+{
+	STATE_MACHINE_ACTIONS_IMMEDIATE,
+	STATE_MACHINE_ACTIONS_DEFERRED,
+	STATE_MACHINE_ACTIONS_COALESCED
+} state_machine_actions_t;
+
+/** State machine transition event
+ *
+ * One transition taken by update_state_machine_batch(), 8 bytes. A
+ * transition back into the same state has from equal to to.
+ */
+typedef struct
+{
+	const state_machine_transition_t* transition;
+	uint16_t sample;
+	uint8_t from;
+	uint8_t to;
+} state_machine_event_t;
+
 /* Empty function for transitions and states that have no function call */
 void STATE_MACHINE_NO_FUNC();
 
 /* Public Functions */
 
-/** Initializes the state machine with the given configuration.
+/** Initializes a state machine with the given configuration.
  *
- * Only after this function is called can the state machine be used.
+ * Only after this function is called can the state machine be used. A
+ * hierarchy that is nested too deeply, loops or has too many states is
+ * reported through Error_Handler() and leaves the machine uninitialized.
  *
+ * @params machine The state machine instance to initialize.
  * @params config A list of states and a hysteresis value.
  * @returns The initial state for the state machine.
  */
-state_machine_state_enum_t initialize_state_machine(state_machine_config_t config);
+state_machine_state_enum_t initialize_state_machine(
+	state_machine_t* machine,
+	const state_machine_config_t* config
+);
 
-/** Updates the state machine with the new parameters.
+/** Updates a state machine with the new parameters.
  *
  * This should be called as frequently as desired. It will handle state
- * transitions as well as state calls.
+ * transitions as well as the state hooks.
  *
+ * @params machine The state machine instance to update.
  * @params params The state machine parameters to update with.
  * @returns The updated state machine state or -1 if uninitialized.
  */
-state_machine_state_enum_t update_state_machine(state_machine_params_t params);
+state_machine_state_enum_t update_state_machine(
+	state_machine_t* machine,
+	const state_machine_params_t* params
+);
+
+/** Updates a state machine with a batch of parameters, oldest first.
+ *
+ * Gives the same states as calling update_state_machine() once per sample,
+ * for replaying a trace, catching up after sleep or a burst of samples.
+ * The transitions taken are listed in events. Once the list is full the
+ * batch stops after the sample of the last event, so the caller continues
+ * from the sample after it.
+ *
+ * @params machine The state machine instance to update.
+ * @params params The samples to update with.
+ * @params count Number of samples.
+ * @params actions How to run the hooks and transition functions.
+ * @params events Filled with the transitions taken.
+ * @params max_events Size of the event list.
+ * @returns The number of events written to the list.
+ */
+uint16_t update_state_machine_batch(
+	state_machine_t* machine,
+	const state_machine_params_t* params,
+	uint16_t count,
+	state_machine_actions_t actions,
+	state_machine_event_t* events,
+	uint16_t max_events
+);
+
+/** Checks if a state machine runs off the band lookup table.
+ *
+ * @params machine An initialized state machine instance.
+ * @returns 1 if the transitions compiled into the table, otherwise 0.
+ */
+uint8_t is_state_machine_band_lut_active(const state_machine_t* machine);
+
+#ifdef __cplusplus
+}
+#endif
 
 #endif
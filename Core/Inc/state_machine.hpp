@@ -0,0 +1,340 @@
+#ifndef STATE_MACHINE_HPP
+#define STATE_MACHINE_HPP
+
+/* Includes */
+#include <cstddef>
+#include <tuple>
+#include <utility>
+#include "state_machine.h"
+
+/** Compile-time state machine engine
+ *
+ * A header-only C++17 counterpart of state_machine.c. States, guards,
+ * hysteresis, dwells and hooks are all template parameters, so the compiler
+ * resolves the transition graph: guards are compared inline, hooks are
+ * direct calls, and there are no tables or function pointers at run time.
+ *
+ * Behaves exactly like update_state_machine() on a flat configuration,
+ * including the hysteresis and dwell bookkeeping. Hierarchical states and
+ * the band lookup table are left to the C engine.
+ */
+namespace state_machine
+{
+
+/* Hooks */
+
+/** A hook that calls the given function. */
+template <void (*Func)()>
+struct hook
+{
+	static void run() { Func(); }
+};
+
+/** A hook that does nothing, the counterpart of NULL and STATE_MACHINE_NO_FUNC. */
+struct no_hook
+{
+	static void run() {}
+};
+
+/* Guards */
+
+/** A guard comparing a signal against a threshold. */
+template <state_machine_signal_t Signal, transition_type_t Type, int32_t Threshold>
+struct guard
+{
+	static constexpr state_machine_signal_t signal = Signal;
+	static constexpr transition_type_t type = Type;
+	static constexpr int32_t threshold = Threshold;
+
+	static bool check(const state_machine_params_t& params, uint32_t hysteresis_adjustment)
+	{
+		const int32_t value = params.signals[Signal];
+		const int32_t adjustment = static_cast<int32_t>(hysteresis_adjustment);
+
+		if constexpr (Type == EQUAL) return value == Threshold;
+		else if constexpr (Type == LESS_THAN) return value < Threshold - adjustment;
+		else if constexpr (Type == GREATER_THAN) return value > Threshold + adjustment;
+		else if constexpr (Type == LT_EQUALS) return value <= Threshold - adjustment;
+		else if constexpr (Type == GT_EQUALS) return value >= Threshold + adjustment;
+		else if constexpr (Type == NOT_EQUALS) return value != Threshold;
+		else return false;
+	}
+};
+
+/** Fills the unused second guard of a single guard transition. */
+using no_guard = guard<0, EMPTY, 0>;
+
+/* Transitions */
+
+/** A transition, with the same fields as state_machine_transition_t. */
+template <
+	state_machine_state_enum_t Next,
+	typename Guard,
+	guard_combination_t Combination = GUARD_SINGLE,
+	typename SecondGuard = no_guard,
+	typename Func = no_hook,
+	uint32_t Hysteresis = STATE_MACHINE_CONFIG_HYSTERESIS,
+	uint32_t Dwell = STATE_MACHINE_NO_DWELL
+>
+struct transition
+{
+	static constexpr state_machine_state_enum_t next_state = Next;
+	static constexpr guard_combination_t combination = Combination;
+	static constexpr uint32_t hysteresis = Hysteresis;
+	static constexpr uint32_t dwell = Dwell;
+	using first_guard = Guard;
+	using second_guard = SecondGuard;
+	using transition_func = Func;
+};
+
+/* States */
+
+/** A state, with the same fields as state_machine_state_t. */
+template <
+	state_machine_state_enum_t State,
+	typename OnEnter,
+	typename OnExit,
+	typename OnTick,
+	typename... Transitions
+>
+struct state
+{
+	static constexpr state_machine_state_enum_t id = State;
+	using on_enter = OnEnter;
+	using on_exit = OnExit;
+	using on_tick = OnTick;
+	using transitions = std::tuple<Transitions...>;
+};
+
+/* Engine */
+
+/** A state machine instance over the given states.
+ *
+ * @tparam Hysteresis The hysteresis of every transition without its own.
+ * @tparam States The states, one of them INITIAL_STATE.
+ */
+template <uint32_t Hysteresis, typename... States>
+class machine
+{
+public:
+	/** Enters the initial state.
+	 *
+	 * @returns The initial state.
+	 */
+	state_machine_state_enum_t initialize()
+	{
+		current_state = INITIAL_STATE;
+		previous_state = INITIAL_STATE;
+		returning_state = INVALID_STATE;
+		triggered = { 0, EMPTY, 0, Hysteresis };
+		pending_transition = no_transition;
+		enter(INITIAL_STATE);
+		return current_state;
+	}
+
+	/** Updates the state machine with the new parameters.
+	 *
+	 * @params params The state machine parameters to update with.
+	 * @returns The updated state machine state.
+	 */
+	state_machine_state_enum_t update(const state_machine_params_t& params)
+	{
+		((current_state == States::id && (step<States>(params), true)) || ...);
+		return current_state;
+	}
+
+	/** Gets the current state. */
+	state_machine_state_enum_t get_state() const { return current_state; }
+
+private:
+	/* Marks that no transition is pending its dwell */
+	static constexpr uint16_t no_transition = 0xFFFF;
+
+	/* Transitions per state a pending transition id leaves room for */
+	static constexpr uint16_t max_transitions = 32;
+
+	static_assert(sizeof...(States) > 0, "A state machine needs at least one state");
+	static_assert(((States::id == INITIAL_STATE) || ...), "No state is the initial state");
+
+	/** First guard of the transition that triggered the hysteresis */
+	struct triggered_guard
+	{
+		int32_t threshold;
+		uint8_t type;
+		state_machine_signal_t signal;
+		uint32_t hysteresis;
+	};
+
+	template <typename Transition>
+	static constexpr uint32_t transition_hysteresis()
+	{
+		return Transition::hysteresis != STATE_MACHINE_CONFIG_HYSTERESIS ?
+			Transition::hysteresis : Hysteresis;
+	}
+
+	/** Checks the transitions of one state and acts on the first that holds. */
+	template <typename State>
+	void step(const state_machine_params_t& params)
+	{
+		constexpr std::size_t count = std::tuple_size_v<typename State::transitions>;
+		static_assert(count < max_transitions, "Too many transitions in a state");
+
+		if (!find<State>(params, std::make_index_sequence<count>()))
+		{
+			pending_transition = no_transition;
+			update_hysteresis(params);
+			State::on_tick::run();
+		}
+	}
+
+	template <typename State, std::size_t... Index>
+	bool find(const state_machine_params_t& params, std::index_sequence<Index...>)
+	{
+		return (take<State, Index, std::tuple_element_t<Index, typename State::transitions>>(params) || ...);
+	}
+
+	/** Takes a transition if it holds, see update_state_machine(). */
+	template <typename State, std::size_t Index, typename Transition>
+	bool take(const state_machine_params_t& params)
+	{
+		static_assert(((States::id == Transition::next_state) || ...),
+			"A transition leads to a state the machine does not have");
+
+		if (!check<Transition>(params)) return false;
+
+		if constexpr (Transition::dwell != STATE_MACHINE_NO_DWELL)
+		{
+			constexpr uint16_t id = static_cast<uint16_t>(State::id * max_transitions + Index);
+			if (!check_dwell<Transition::dwell>(id, params))
+			{
+				/* Hold off until the transition held for its whole dwell */
+				update_hysteresis(params);
+				State::on_tick::run();
+				return true;
+			}
+		}
+		pending_transition = no_transition;
+
+		update_hysteresis<Transition>(params);
+		if constexpr (Transition::next_state != State::id)
+		{
+			previous_state = State::id;
+			returning_state = State::id;
+			update_hysteresis<Transition>(params);
+
+			State::on_exit::run();
+			Transition::transition_func::run();
+			current_state = Transition::next_state;
+			enter(Transition::next_state);
+			tick(Transition::next_state);
+		}
+		else
+		{
+			Transition::transition_func::run();
+			State::on_tick::run();
+		}
+		return true;
+	}
+
+	template <typename Transition>
+	bool check(const state_machine_params_t& params) const
+	{
+		using first = typename Transition::first_guard;
+		using second = typename Transition::second_guard;
+		const uint32_t adjustment = (returning_state == Transition::next_state) ?
+			transition_hysteresis<Transition>() : HYSTERESIS_DISABLED;
+		const bool result = first::check(params,
+			(first::signal == triggered.signal) ? adjustment : HYSTERESIS_DISABLED);
+
+		if constexpr (Transition::combination == GUARD_AND)
+			return result && second::check(params,
+				(second::signal == triggered.signal) ? adjustment : HYSTERESIS_DISABLED);
+		else if constexpr (Transition::combination == GUARD_OR)
+			return result || second::check(params,
+				(second::signal == triggered.signal) ? adjustment : HYSTERESIS_DISABLED);
+		else
+			return result;
+	}
+
+	template <uint32_t Dwell>
+	bool check_dwell(uint16_t id, const state_machine_params_t& params)
+	{
+		constexpr uint32_t dwell = Dwell & ~STATE_MACHINE_DWELL_US_FLAG;
+
+		if (id != pending_transition)
+		{
+			pending_transition = id;
+			pending_dwell = (Dwell & STATE_MACHINE_DWELL_US_FLAG) ? params.timestamp_us : 0;
+		}
+		if constexpr ((Dwell & STATE_MACHINE_DWELL_US_FLAG) != 0)
+			return params.timestamp_us - pending_dwell >= dwell;
+		else
+			return ++pending_dwell >= dwell;
+	}
+
+	/** Updates the hysteresis after a transition, see update_hysteresis_thresholds(). */
+	template <typename Transition>
+	void update_hysteresis(const state_machine_params_t& params)
+	{
+		using first = typename Transition::first_guard;
+
+		if (returning_state == INVALID_STATE && Hysteresis != HYSTERESIS_DISABLED) return;
+
+		if constexpr (first::type != EMPTY)
+		{
+			returning_state = previous_state;
+			triggered = { first::threshold, first::type, first::signal, transition_hysteresis<Transition>() };
+		}
+		release_hysteresis(params);
+	}
+
+	/** Updates the hysteresis without a transition. */
+	void update_hysteresis(const state_machine_params_t& params)
+	{
+		if (returning_state == INVALID_STATE && Hysteresis != HYSTERESIS_DISABLED) return;
+
+		release_hysteresis(params);
+	}
+
+	void release_hysteresis(const state_machine_params_t& params)
+	{
+		const int32_t value = params.signals[triggered.signal];
+		const int32_t hysteresis = static_cast<int32_t>(triggered.hysteresis);
+
+		switch(triggered.type)
+		{
+		case LESS_THAN:
+		case LT_EQUALS:
+			if (value <= triggered.threshold - hysteresis) returning_state = INVALID_STATE;
+			break;
+		case GREATER_THAN:
+		case GT_EQUALS:
+			if (value >= triggered.threshold + hysteresis) returning_state = INVALID_STATE;
+			break;
+		default:
+			returning_state = INVALID_STATE;
+			break;
+		}
+	}
+
+	static void enter(state_machine_state_enum_t next)
+	{
+		((next == States::id && (States::on_enter::run(), true)) || ...);
+	}
+
+	static void tick(state_machine_state_enum_t next)
+	{
+		((next == States::id && (States::on_tick::run(), true)) || ...);
+	}
+
+	uint64_t pending_dwell = 0;
+	triggered_guard triggered = { 0, EMPTY, 0, Hysteresis };
+	state_machine_state_enum_t current_state = INITIAL_STATE;
+	state_machine_state_enum_t previous_state = INITIAL_STATE;
+	state_machine_state_enum_t returning_state = INVALID_STATE;
+	uint16_t pending_transition = no_transition;
+};
+
+}
+
+#endif
@@ -60,7 +60,9 @@ void DMA1_Channel5_IRQHandler(void);
 void DMA1_Channel7_IRQHandler(void);
 void TIM2_IRQHandler(void);
 /* USER CODE BEGIN EFP */
-
+void DMA1_Channel1_IRQHandler(void);
+void TIM5_IRQHandler(void);
+void USART2_IRQHandler(void);
 /* USER CODE END EFP */
 
 #ifdef __cplusplus
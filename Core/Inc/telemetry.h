@@ -0,0 +1,52 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include "main.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Defines */
+
+/** UART telemetry
+ *
+ * Reports are queued and sent over USART2 by DMA in the background. Each
+ * transfer starts the next one from the transmit complete interrupt at
+ * TELEMETRY_IRQ_PRIORITY, so tasks writing reports never wait for the UART.
+ */
+
+/* Bytes queued until sent, a power of two. At 115200 baud it drains in
+ * about 90 ms, one report period */
+#define TELEMETRY_BUFFER_SIZE 1024
+
+/* Public Functions */
+
+/** Starts the telemetry with nothing queued.
+ *
+ * Must be called once, after MX_USART2_UART_Init().
+ */
+void initialize_telemetry();
+
+/** Queues bytes to send and starts sending if the UART is idle.
+ *
+ * Never waits. Data that does not fit is dropped whole and counted. Only
+ * one context may write.
+ *
+ * @params data The bytes to send.
+ * @params size Number of bytes.
+ * @returns 1 if the data was queued, 0 if it was dropped.
+ */
+uint8_t write_telemetry(const char* data, uint32_t size);
+
+/** Gets the number of writes dropped because the queue was full.
+ *
+ * @returns The drop count since the telemetry was started.
+ */
+uint32_t get_telemetry_drops();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef TIMESTAMP_H
+#define TIMESTAMP_H
+
+#include "main.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Defines */
+
+/** Timestamp service
+ *
+ * A 64 bit monotonic microsecond clock built on the DWT cycle counter. The
+ * counter is 32 bits and wraps every 53 s at 80 MHz, so every read extends
+ * it into the 64 bit count. SysTick reads it every millisecond, so no wrap
+ * is ever missed even when nothing else asks for the time.
+ *
+ * The counter stops while the core sleeps, so whoever puts it to sleep
+ * must advance the clock by the time slept.
+ */
+
+/* Public Functions */
+
+/** Starts the cycle counter behind the clock.
+ *
+ * Must be called once, after SystemClock_Config().
+ */
+void initialize_timestamp();
+
+/** Gets the time since initialize_timestamp().
+ *
+ * Constant time and safe to call from any interrupt.
+ *
+ * @returns The time in microseconds.
+ */
+uint64_t get_timestamp_us();
+
+/** Advances the clock by time the cycle counter did not count.
+ *
+ * @params elapsed_us The time in microseconds to add.
+ */
+void advance_timestamp(uint32_t elapsed_us);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
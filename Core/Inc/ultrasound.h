@@ -2,10 +2,329 @@
 #define ULTRASOUND_H
 
 #include "main.h"
+#include "timestamp.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Defines */
+
+/* Most sensors the module can drive, one per TIM2 capture channel */
+#define ULTRASOUND_MAX_SENSORS 4
+
+/** Number of HC-SR04 sensors fitted.
+ *
+ * Sensor n echoes on TIM2 CH(n + 1) and is triggered from its own TIM5
+ * channel. The sensors take turns, one ping per TIM5 period, so only one
+ * ping is ever in flight and they cannot hear each other. Every sensor
+ * keeps its own edge ring and sample stream.
+ *
+ * More than one sensor requires ULTRASOUND_SYNC_CAPTURE to be disabled.
+ */
+#define ULTRASOUND_SENSOR_COUNT 1
+
+/** Interrupt-free capture.
+ *
+ * When enabled, the capture DMA runs circular with its interrupts and NVIC
+ * line off, and the edge ring is only drained when a reader polls it, in
+ * the TIM2 interrupt the reader pends. The DMA write index tells how far
+ * the ring is filled. Readers must then poll at least once every
+ * ULTRASOUND_EDGE_RING_SIZE / 2 echoes or echoes are overwritten, which
+ * get_ultrasound_edge_overruns() counts.
+ * Interrupt captured sensors are not affected.
+ */
+#define ULTRASOUND_POLLED_CAPTURE 0
+
+/** Number of edges held by the TIM2 CH1 capture DMA ring.
+ *
+ * Must be even and at least 4. Every edge is one word, a rising and
+ * falling edge make up one echo. The DMA half and full transfer
+ * interrupts each drain half of this ring at once, so at 4 every echo is
+ * published as soon as it ends. Larger rings trade echo latency for fewer
+ * interrupts.
+ *
+ * Polled capture only drains the ring when read. A reader every 100 ms
+ * at the critical alert's 30 Hz finds 6 edges, so the polled ring holds 16
+ * and a read can slip to over 250 ms before echoes are overwritten.
+ */
+#if ULTRASOUND_POLLED_CAPTURE
+#define ULTRASOUND_EDGE_RING_SIZE 16
+#else
+#define ULTRASOUND_EDGE_RING_SIZE 4
+#endif
+
+/* Number of completed echoes buffered per sensor while a reader is attached,
+ * a power of two */
+#define ULTRASOUND_ECHO_QUEUE_SIZE 8
+
+/* Number of samples of all sensors buffered until read out, a power of two */
+#define ULTRASOUND_SAMPLE_QUEUE_SIZE 16
+
+/* Longest echo pulse in us the HC-SR04 produces (no object in range) */
+#define ULTRASOUND_MAX_ECHO_US 38000
+
+/* Echoes at least this long in us are the sensor's own no-echo timeout */
+#define ULTRASOUND_ECHO_TIMEOUT_US 30000
+
+/* Echo widths in us for the rated 2 cm to 400 cm range */
+#define ULTRASOUND_MIN_RANGE_US 116
+#define ULTRASOUND_MAX_RANGE_US 23200
+
+/* Echo width in us per cm of range */
+#define ULTRASOUND_US_PER_CM 58
+
+/* Default speed of sound in m/s, dry air at 20 C */
+#define ULTRASOUND_SPEED_OF_SOUND_M_S 343
+
+/* Speeds of sound in m/s accepted, air from about -50 C to 125 C */
+#define ULTRASOUND_MIN_SPEED_OF_SOUND_M_S 300
+#define ULTRASOUND_MAX_SPEED_OF_SOUND_M_S 400
+
+/** Fractional bits of the echo width to distance scale.
+ *
+ * Distances are worked out as echo_us * scale >> ULTRASOUND_SCALE_BITS, so
+ * there is no division per echo. With 16 bits and at most
+ * ULTRASOUND_MAX_SPEED_OF_SOUND_M_S, the product stays within 32 bits for
+ * any echo TIM2 can capture.
+ */
+#define ULTRASOUND_SCALE_BITS 16
+
+/* Time in ms without a new sample after which the sensor counts as lost */
+#define ULTRASOUND_SAMPLE_TIMEOUT_MS 250
+
+/** Synchronized time of flight capture.
+ *
+ * When enabled, every echo line edge resets TIM2 through its slave
+ * controller, so the falling edge capture is the time of flight itself.
+ * No subtraction or TIM2 wrap handling is needed per echo.
+ */
+#define ULTRASOUND_SYNC_CAPTURE 1
+
+/* Delay in us from the trigger pulse to the start of the echo pulse */
+#define ULTRASOUND_TRIGGER_TO_ECHO_US 500
+
+/** Settling time in us after an echo before the sensor may be re-triggered.
+ *
+ * Together with the last echo, this bounds how fast the ping rate may go
+ * without the previous ping's echo being taken for the next one.
+ */
+#define ULTRASOUND_RETRIGGER_GUARD_US 10000
+
+/* Ping rate in Hz used by enable_ultrasound() */
+#define ULTRASOUND_DEFAULT_PING_RATE_HZ 10
+
+/* Width of the trigger pulse in us, the HC-SR04 needs at least 10 us */
+#define ULTRASOUND_TRIGGER_PULSE_US 20
+
+/** Echo-triggered burst acquisition.
+ *
+ * When enabled, the end of every echo re-arms the trigger in hardware:
+ * TIM2 TRGO restarts TIM5 in one-pulse mode, which fires the next trigger
+ * once the ringdown guard time has passed. The ping rate then follows the
+ * range instead of set_ultrasound_ping_rate(). If no echo edge is seen for
+ * a whole TIM2 period, its overflow re-arms the trigger as well.
+ *
+ * Requires ULTRASOUND_SYNC_CAPTURE.
+ */
+#define ULTRASOUND_BURST_MODE 0
+
+/* Default ringdown guard time in us between an echo and the next trigger */
+#define ULTRASOUND_BURST_GUARD_US 2000
+
+/* Typedefs */
+
+/** Ultrasound sample status
+ *
+ * OK: The echo is within the rated range.
+ * TIMEOUT: The sensor saw no echo and timed out.
+ * OUT_OF_RANGE: An echo arrived, but outside of the rated range.
+ */
+typedef enum
+{
+	ULTRASOUND_SAMPLE_OK,
+	ULTRASOUND_SAMPLE_TIMEOUT,
+	ULTRASOUND_SAMPLE_OUT_OF_RANGE
+} ultrasound_sample_status_t;
+
+/** Ultrasound sample
+ *
+ * A single completed echo as published by the capture interrupt.
+ * timestamp_us is the time the echo ended, taken from the capture itself
+ * rather than the time it was published.
+ */
+typedef struct
+{
+	uint32_t sequence;
+	uint8_t sensor;
+	uint64_t timestamp_us;
+	uint32_t echo_us;
+	uint32_t distance_mm;
+	ultrasound_sample_status_t status;
+} ultrasound_sample_t;
+
+/* Public Functions */
 
 void enable_ultrasound();
 void disable_ultrasound();
-float get_read_cm();
+uint32_t get_read_cm();
+uint32_t get_read_mm();
 uint32_t get_read_us();
 
+/** Converts an echo width to a distance.
+ *
+ * Integer only and constant time, so it is safe to call from an ISR.
+ *
+ * @params echo_us The echo width in microseconds.
+ * @returns The distance to the object in millimeters.
+ */
+uint32_t ultrasound_echo_to_mm(uint32_t echo_us);
+
+/** Sets the speed of sound used for every distance from now on.
+ *
+ * @params speed_m_s The speed of sound in m/s, clamped to
+ * ULTRASOUND_MIN_SPEED_OF_SOUND_M_S to ULTRASOUND_MAX_SPEED_OF_SOUND_M_S.
+ */
+void set_ultrasound_speed_of_sound(uint32_t speed_m_s);
+
+/** Starts queueing the echoes of a sensor for read_ultrasound_echoes().
+ *
+ * Echoes are only queued while a reader is attached, so a reader never
+ * gets echoes from before it attached. Called from the reading context.
+ *
+ * @params sensor The sensor to read, below ULTRASOUND_SENSOR_COUNT.
+ */
+void attach_ultrasound_echo_reader(uint8_t sensor);
+
+/** Stops queueing the echoes of a sensor.
+ *
+ * @params sensor The sensor to stop reading, below ULTRASOUND_SENSOR_COUNT.
+ */
+void detach_ultrasound_echo_reader(uint8_t sensor);
+
+/** Reads out every echo of a sensor completed since the last call.
+ *
+ * Echoes are returned oldest first, starting with the first echo after
+ * attach_ultrasound_echo_reader(). If more than ULTRASOUND_ECHO_QUEUE_SIZE
+ * echoes complete between calls, the newer ones are dropped and counted.
+ * Only one context may read the echoes of a sensor.
+ *
+ * @params sensor The sensor to read, below ULTRASOUND_SENSOR_COUNT.
+ * @params echoes_us Buffer to fill with echo widths in microseconds.
+ * @params max_echoes Size of the buffer.
+ * @returns The number of echoes written to the buffer.
+ */
+uint32_t read_ultrasound_echoes(uint8_t sensor, uint32_t* echoes_us, uint32_t max_echoes);
+
+/** Gets the latest sample of a sensor if it is newer than the given sequence.
+ *
+ * Safe to call while the capture interrupt publishes a new sample; the copy
+ * is never a mix of two samples. Sequence numbers start at 1, so passing 0
+ * returns any sample captured so far.
+ *
+ * @params sensor The sensor to read, below ULTRASOUND_SENSOR_COUNT.
+ * @params sample Filled with the latest sample if it is new.
+ * @params last_sequence The sequence of the last sample the caller handled.
+ * @returns 1 if a new sample was copied, otherwise 0.
+ */
+uint8_t get_ultrasound_sample(
+	uint8_t sensor,
+	ultrasound_sample_t* sample,
+	uint32_t last_sequence
+);
+
+/** Reads out every sample of any sensor published since the last call.
+ *
+ * Samples are returned oldest first, so no echo is missed between two
+ * calls. If more than ULTRASOUND_SAMPLE_QUEUE_SIZE samples are published
+ * between calls, the newer ones are dropped and counted. Only one context
+ * may read the samples.
+ *
+ * @params samples Buffer to fill with samples.
+ * @params max_samples Size of the buffer.
+ * @returns The number of samples written to the buffer.
+ */
+uint32_t read_ultrasound_samples(ultrasound_sample_t* samples, uint32_t max_samples);
+
+/** Gets the number of echoes of a sensor dropped because the attached reader
+ * fell behind.
+ *
+ * @params sensor The sensor to check, below ULTRASOUND_SENSOR_COUNT.
+ * @returns The drop count since the ultrasound was enabled.
+ */
+uint32_t get_ultrasound_echo_drops(uint8_t sensor);
+
+/** Gets the number of times the polled capture DMA overran a sensor's edges.
+ *
+ * Only counted with ULTRASOUND_POLLED_CAPTURE. After an overrun, the newest
+ * ULTRASOUND_EDGE_RING_SIZE edges are still processed.
+ *
+ * @params sensor The sensor to check, below ULTRASOUND_SENSOR_COUNT.
+ * @returns The overrun count since the ultrasound was enabled.
+ */
+uint32_t get_ultrasound_edge_overruns(uint8_t sensor);
+
+/** Gets the number of samples dropped because nobody read them.
+ *
+ * @returns The drop count since the ultrasound was enabled.
+ */
+uint32_t get_ultrasound_sample_drops();
+
+/** Checks if a sample is too old to act on.
+ *
+ * @params sample The sample to check.
+ * @returns 1 if no sample followed for ULTRASOUND_SAMPLE_TIMEOUT_MS.
+ */
+uint8_t is_ultrasound_sample_stale(const ultrasound_sample_t* sample);
+
+/** Requests a new ping rate for every sensor.
+ *
+ * Has no effect in burst mode, where the echoes pace the pings. With several
+ * sensors, TIM5 fires at this rate times the sensor count.
+ *
+ * The new period is loaded through the TIM5 auto-reload preload, so it
+ * takes effect at the next update event and never cuts a ping short. The
+ * rate is lowered if it would re-trigger the sensor before the echo of the
+ * last measured range and its guard time are over.
+ *
+ * @params rate_hz The requested ping rate in Hz.
+ */
+void set_ultrasound_ping_rate(uint32_t rate_hz);
+
+/** Gets the ping period of each sensor currently loaded in the trigger timer.
+ *
+ * @returns The ping period in microseconds.
+ */
+uint32_t get_ultrasound_ping_period_us();
+
+/** Drains the DMA edges and reloads the ping period when a reader asked.
+ *
+ * Readers and set_ultrasound_ping_rate() never touch the edges or TIM5
+ * themselves, they pend TIM2 and this runs there, after
+ * HAL_TIM_IRQHandler(). Every edge is so processed at the acquisition
+ * priority and readers only pop the queues, with no interrupts masked.
+ */
+void process_ultrasound_requests();
+
+/** Called whenever a sensor publishes a sample.
+ *
+ * Does nothing unless overridden. Runs in the capture interrupt, so an
+ * override should only hand the work off, for example by pending PendSV.
+ *
+ * @params sensor The sensor that published the sample.
+ */
+void ultrasound_sample_callback(uint8_t sensor);
+
+/** Sets the ringdown guard time used in burst mode.
+ *
+ * Takes effect from the next ping on.
+ *
+ * @params guard_us Time from the end of an echo to the next trigger in us.
+ */
+void set_ultrasound_burst_guard(uint32_t guard_us);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif
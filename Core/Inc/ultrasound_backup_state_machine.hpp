@@ -0,0 +1,75 @@
+/* Generated by Tools/state_machine_compiler.py from Tools/ultrasound_backup.sm, do not edit */
+#ifndef ULTRASOUND_BACKUP_STATE_MACHINE_HPP
+#define ULTRASOUND_BACKUP_STATE_MACHINE_HPP
+
+#include "state_machine.hpp"
+#include "ultrasound_backup_tables.h"
+
+/** Compile-time ultrasound_backup state machine
+ *
+ * The same states, guards and hooks as ultrasound_backup_config, for state_machine.hpp.
+ */
+namespace ultrasound_backup
+{
+
+using namespace state_machine;
+
+/* States */
+using no_alert_state = state<NO_ALERT,
+	hook<no_alert_func>, no_hook, no_hook,
+	transition<CRITICAL_ALERT, guard<DISTANCE_SIGNAL, LT_EQUALS, CRITICAL_ALERT_MM>,
+		GUARD_OR, guard<TIME_TO_COLLISION_SIGNAL, LT_EQUALS, CRITICAL_ALERT_TTC_MS>,
+		no_hook, HYSTERESIS_DISABLED>,
+	transition<LOW_ALERT, guard<DISTANCE_SIGNAL, LT_EQUALS, LOW_ALERT_MM>>
+>;
+
+using low_alert_state = state<LOW_ALERT,
+	hook<low_alert_func>, no_hook, no_hook,
+	transition<CRITICAL_ALERT, guard<DISTANCE_SIGNAL, LT_EQUALS, CRITICAL_ALERT_MM>,
+		GUARD_OR, guard<TIME_TO_COLLISION_SIGNAL, LT_EQUALS, CRITICAL_ALERT_TTC_MS>,
+		no_hook, HYSTERESIS_DISABLED>,
+	transition<NO_ALERT, guard<DISTANCE_SIGNAL, GREATER_THAN, LOW_ALERT_MM>,
+		GUARD_SINGLE, no_guard,
+		no_hook, STATE_MACHINE_CONFIG_HYSTERESIS, STATE_MACHINE_DWELL_US(ALERT_CLEAR_DWELL_MS * 1000)>,
+	transition<MEDIUM_ALERT, guard<DISTANCE_SIGNAL, LT_EQUALS, MEDIUM_ALERT_MM>>
+>;
+
+using medium_alert_state = state<MEDIUM_ALERT,
+	hook<medium_alert_func>, no_hook, no_hook,
+	transition<CRITICAL_ALERT, guard<DISTANCE_SIGNAL, LT_EQUALS, CRITICAL_ALERT_MM>,
+		GUARD_OR, guard<TIME_TO_COLLISION_SIGNAL, LT_EQUALS, CRITICAL_ALERT_TTC_MS>,
+		no_hook, HYSTERESIS_DISABLED>,
+	transition<LOW_ALERT, guard<DISTANCE_SIGNAL, GREATER_THAN, MEDIUM_ALERT_MM>,
+		GUARD_SINGLE, no_guard,
+		no_hook, STATE_MACHINE_CONFIG_HYSTERESIS, STATE_MACHINE_DWELL_US(ALERT_CLEAR_DWELL_MS * 1000)>,
+	transition<HIGH_ALERT, guard<DISTANCE_SIGNAL, LT_EQUALS, HIGH_ALERT_MM>>
+>;
+
+using high_alert_state = state<HIGH_ALERT,
+	hook<high_alert_func>, no_hook, no_hook,
+	transition<CRITICAL_ALERT, guard<DISTANCE_SIGNAL, LT_EQUALS, CRITICAL_ALERT_MM>,
+		GUARD_OR, guard<TIME_TO_COLLISION_SIGNAL, LT_EQUALS, CRITICAL_ALERT_TTC_MS>>,
+	transition<MEDIUM_ALERT, guard<DISTANCE_SIGNAL, GREATER_THAN, HIGH_ALERT_MM>,
+		GUARD_SINGLE, no_guard,
+		no_hook, STATE_MACHINE_CONFIG_HYSTERESIS, STATE_MACHINE_DWELL_US(ALERT_CLEAR_DWELL_MS * 1000)>
+>;
+
+using critical_alert_state = state<CRITICAL_ALERT,
+	hook<critical_alert_func>, hook<critical_alert_exit_func>, no_hook,
+	transition<HIGH_ALERT, guard<DISTANCE_SIGNAL, GREATER_THAN, CRITICAL_ALERT_MM>,
+		GUARD_AND, guard<TIME_TO_COLLISION_SIGNAL, GREATER_THAN, CRITICAL_ALERT_TTC_MS>,
+		no_hook, STATE_MACHINE_CONFIG_HYSTERESIS, STATE_MACHINE_DWELL_US(ALERT_CLEAR_DWELL_MS * 1000)>
+>;
+
+/* Final State Machine Type */
+using machine_type = machine<HYSTERESIS,
+	no_alert_state,
+	low_alert_state,
+	medium_alert_state,
+	high_alert_state,
+	critical_alert_state
+>;
+
+}
+
+#endif
@@ -0,0 +1,63 @@
+/* Generated by Tools/state_machine_compiler.py from Tools/ultrasound_backup.sm, do not edit */
+#ifndef ULTRASOUND_BACKUP_TABLES_H
+#define ULTRASOUND_BACKUP_TABLES_H
+
+#include "state_machine.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Constants */
+/* Hysteresis for this state machine in mm */
+#define HYSTERESIS 20
+/* Alert thresholds in mm */
+#define LOW_ALERT_MM 300
+#define MEDIUM_ALERT_MM 200
+#define HIGH_ALERT_MM 120
+#define CRITICAL_ALERT_MM 80
+/* Time to collision in ms that raises the critical alert at any range */
+#define CRITICAL_ALERT_TTC_MS 500
+/* Time in ms an alert has to stay clear before it is lowered */
+#define ALERT_CLEAR_DWELL_MS 200
+
+/* States */
+typedef enum
+{
+	NO_ALERT = 0,
+	LOW_ALERT,
+	MEDIUM_ALERT,
+	HIGH_ALERT,
+	CRITICAL_ALERT,
+	ULTRASOUND_BACKUP_END_STATE
+} ultrasound_backup_state_t;
+
+/* Signals */
+typedef enum
+{
+	DISTANCE_SIGNAL = 0,
+	VELOCITY_SIGNAL,
+	TIME_TO_COLLISION_SIGNAL,
+	SENSOR_SIGNAL,
+	SAMPLE_AGE_SIGNAL
+} ultrasound_backup_signal_t;
+
+/* State Machine Functions */
+void no_alert_func();
+void low_alert_func();
+void medium_alert_func();
+void high_alert_func();
+void critical_alert_func();
+void critical_alert_exit_func();
+
+/** Final State Machine Configuration
+ *
+ * This is passed into the state machine init function.
+ */
+extern const state_machine_config_t ultrasound_backup_config;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,83 @@
+#include "activity.h"
+#include "timestamp.h"
+
+/* Private Variables */
+
+/* Nesting of running code, 0 while the core sleeps */
+uint32_t activity_depth = 0;
+/* Cycle counter value when the core last woke */
+uint32_t wake_cycles = 0;
+/* Wakes and running cycles since the last read */
+uint32_t activity_wakes = 0;
+uint64_t active_cycles = 0;
+/* Time of the last read */
+uint64_t activity_start_us = 0;
+
+/* Public Function Implementations */
+
+void initialize_activity()
+{
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq();
+	activity_depth = 1;
+	wake_cycles = DWT->CYCCNT;
+	activity_wakes = 0;
+	active_cycles = 0;
+	activity_start_us = get_timestamp_us();
+	__set_PRIMASK(primask);
+}
+
+void enter_activity()
+{
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq();
+	if (activity_depth++ == 0)
+	{
+		activity_wake_callback();
+		wake_cycles = DWT->CYCCNT;
+		activity_wakes++;
+	}
+	__set_PRIMASK(primask);
+}
+
+void exit_activity()
+{
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq();
+	if (activity_depth > 0 && --activity_depth == 0)
+	{
+		active_cycles += DWT->CYCCNT - wake_cycles;
+	}
+	__set_PRIMASK(primask);
+}
+
+__weak void activity_wake_callback()
+{
+}
+
+void read_activity(activity_stats_t* stats)
+{
+	uint32_t primask = __get_PRIMASK();
+	uint64_t now_us;
+	uint32_t cycles;
+
+	__disable_irq();
+	now_us = get_timestamp_us();
+	cycles = DWT->CYCCNT;
+	if (activity_depth > 0)
+	{
+		/* The caller is running, so count up to now and carry on from here */
+		active_cycles += cycles - wake_cycles;
+		wake_cycles = cycles;
+	}
+	stats->wakes = activity_wakes;
+	stats->active_us = (uint32_t)(active_cycles / (SystemCoreClock / 1000000));
+	stats->elapsed_us = (uint32_t)(now_us - activity_start_us);
+	activity_wakes = 0;
+	active_cycles = 0;
+	activity_start_us = now_us;
+	__set_PRIMASK(primask);
+}
@@ -0,0 +1,309 @@
+#include "alert_pipeline.h"
+#include "ultrasound.h"
+#include "ultrasound_backup_state_machine.h"
+#include "timestamp.h"
+#include "range_filter.h"
+#include "range_tracker.h"
+#include "spsc_ring.h"
+
+#if ALERT_PIPELINE_PENDSV && ULTRASOUND_POLLED_CAPTURE
+#error "ALERT_PIPELINE_PENDSV requires ULTRASOUND_POLLED_CAPTURE to be disabled"
+#endif
+
+#if !SPSC_RING_IS_POWER_OF_TWO(ALERT_PIPELINE_EVENT_QUEUE_SIZE) || \
+		!SPSC_RING_IS_POWER_OF_TWO(ALERT_PIPELINE_TELEMETRY_QUEUE_SIZE)
+#error "ALERT_PIPELINE_EVENT_QUEUE_SIZE and ALERT_PIPELINE_TELEMETRY_QUEUE_SIZE must be powers of two"
+#endif
+
+/* Private Defines */
+
+/* Samples read out of the ultrasound queue at once */
+#define SAMPLE_BATCH_SIZE 4
+
+/* Range fed for a sensor that sees nothing within its rated range */
+#define NO_OBJECT_MM (ULTRASOUND_MAX_RANGE_US * 10 / ULTRASOUND_US_PER_CM)
+
+/* Private Variables */
+
+state_machine_t alert_machine = {0};
+state_machine_params_t alert_params =
+{
+	.signals = { [DISTANCE_SIGNAL] = 4000 }
+};
+
+ultrasound_sample_t pipeline_samples[ULTRASOUND_SENSOR_COUNT] = {0};
+range_filter_t pipeline_filters[ULTRASOUND_SENSOR_COUNT];
+range_tracker_t pipeline_trackers[ULTRASOUND_SENSOR_COUNT];
+int32_t pipeline_lead_mm[ULTRASOUND_SENSOR_COUNT] = {0};
+
+/* Alert changes and telemetry on their way to the reporting */
+alert_pipeline_event_t event_queue_buffer[ALERT_PIPELINE_EVENT_QUEUE_SIZE];
+spsc_ring_t event_queue = {0};
+alert_pipeline_telemetry_t telemetry_queue_buffer[ALERT_PIPELINE_TELEMETRY_QUEUE_SIZE];
+spsc_ring_t telemetry_queue = {0};
+
+/** Status of the last pipeline run
+ *
+ * Guarded by a sequence lock: status_lock is odd while the status is being
+ * written, so readers retry until they see the same even value on both
+ * sides of their copy.
+ */
+volatile uint32_t status_lock = 0;
+alert_pipeline_status_t pipeline_status = {0};
+
+/* Private Functions */
+
+/** Filters and tracks a sample into the range its sensor reports.
+ *
+ * Only OK samples are tracked. An echo too short to resolve reports 0 mm,
+ * and no echo or one beyond the rated range reports NO_OBJECT_MM and drops
+ * the track.
+ *
+ * @params sample The sample to track.
+ */
+void track_sample(const ultrasound_sample_t* sample);
+
+/** Updates the state machine off the nearest object of any sensor.
+ *
+ * A lost sensor reports LOST_SENSOR_MM, so a dead sensor holds an alert
+ * instead of reading clear. A sensor that has not published yet is left
+ * out. Queues a telemetry record, and an event if the
+ * alert changed.
+ *
+ * @params lost_sensors The sensors currently lost.
+ * @params timestamp_us The time of the update.
+ */
+void update_alert(uint8_t lost_sensors, uint64_t timestamp_us);
+
+/** Publishes the status of a state machine update.
+ *
+ * @params record The telemetry record of the update.
+ * @params lost_sensors The sensors currently lost.
+ */
+void publish_status(const alert_pipeline_telemetry_t* record, uint8_t lost_sensors);
+
+/* Public Function Implementations */
+
+void initialize_alert_pipeline()
+{
+	uint8_t sensor;
+
+	for (sensor = 0; sensor < ULTRASOUND_SENSOR_COUNT; sensor++)
+	{
+		initialize_range_filter(&pipeline_filters[sensor]);
+		initialize_range_tracker(&pipeline_trackers[sensor]);
+	}
+	initialize_spsc_ring(&event_queue, event_queue_buffer,
+		sizeof(alert_pipeline_event_t), ALERT_PIPELINE_EVENT_QUEUE_SIZE);
+	initialize_spsc_ring(&telemetry_queue, telemetry_queue_buffer,
+		sizeof(alert_pipeline_telemetry_t), ALERT_PIPELINE_TELEMETRY_QUEUE_SIZE);
+	pipeline_status.state = initialize_state_machine(&alert_machine, &ultrasound_backup_config);
+#if ALERT_PIPELINE_PENDSV
+	HAL_NVIC_SetPriority(PendSV_IRQn, ALERT_PIPELINE_PENDSV_PRIORITY, 0);
+#endif
+}
+
+void run_alert_pipeline()
+{
+	ultrasound_sample_t samples[SAMPLE_BATCH_SIZE];
+	uint8_t lost_sensors = pipeline_status.lost_sensors;
+	uint32_t count;
+	uint32_t i;
+	uint8_t sensor;
+
+	/* Every echo is acted on, in the order the sensors published them */
+	while ((count = read_ultrasound_samples(samples, SAMPLE_BATCH_SIZE)) > 0)
+	{
+		for (i = 0; i < count; i++)
+		{
+			sensor = samples[i].sensor;
+			pipeline_samples[sensor] = samples[i];
+			lost_sensors &= ~(1U << sensor);
+			track_sample(&samples[i]);
+			update_alert(lost_sensors, samples[i].timestamp_us);
+		}
+	}
+
+	for (sensor = 0; sensor < ULTRASOUND_SENSOR_COUNT; sensor++)
+	{
+		if (!(lost_sensors & (1U << sensor)) && is_ultrasound_sample_stale(&pipeline_samples[sensor]))
+		{
+			lost_sensors |= 1U << sensor;
+			initialize_range_tracker(&pipeline_trackers[sensor]);
+		}
+	}
+
+	/* A lost sensor sends no echoes, so the machine is stepped here instead.
+	 * This keeps the alert at the fault level and lets its dwells run out. */
+	if (lost_sensors != 0)
+	{
+		update_alert(lost_sensors, get_timestamp_us());
+	}
+}
+
+void request_alert_pipeline()
+{
+#if ALERT_PIPELINE_PENDSV
+	SCB->ICSR = SCB_ICSR_PENDSVSET_Msk;
+#else
+	run_alert_pipeline();
+#endif
+}
+
+uint8_t get_alert_pipeline_status(alert_pipeline_status_t* status, uint32_t last_sequence)
+{
+	uint32_t lock;
+
+	do
+	{
+		lock = status_lock;
+		__DMB();
+		*status = pipeline_status;
+		__DMB();
+	} while ((lock & 1) || lock != status_lock);
+
+	return status->sequence != last_sequence;
+}
+
+uint32_t read_alert_pipeline_events(alert_pipeline_event_t* events, uint32_t max_events)
+{
+	uint32_t count = 0;
+
+	while (count < max_events && pop_spsc_ring(&event_queue, &events[count])) count++;
+	return count;
+}
+
+uint32_t read_alert_pipeline_telemetry(alert_pipeline_telemetry_t* records, uint32_t max_records)
+{
+	uint32_t count = 0;
+
+	while (count < max_records && pop_spsc_ring(&telemetry_queue, &records[count])) count++;
+	return count;
+}
+
+/* Ultrasound sample callback: a new echo is ready for the pipeline */
+void ultrasound_sample_callback(uint8_t sensor)
+{
+	UNUSED(sensor);
+#if ALERT_PIPELINE_PENDSV
+	SCB->ICSR = SCB_ICSR_PENDSVSET_Msk;
+#endif
+}
+
+/* Private Function Implementations */
+
+void track_sample(const ultrasound_sample_t* sample)
+{
+	uint8_t sensor = sample->sensor;
+
+	switch (sample->status)
+	{
+	case ULTRASOUND_SAMPLE_OK:
+		/* Single sample spikes are dropped before the tracker sees them */
+		update_range_tracker(&pipeline_trackers[sensor],
+			update_range_filter(&pipeline_filters[sensor], sample->distance_mm),
+			sample->timestamp_us);
+		/* An object closing in raises the alert ALERT_LEAD_MS early */
+		pipeline_lead_mm[sensor] = get_range_tracker_lead_mm(&pipeline_trackers[sensor], ALERT_LEAD_MS);
+		break;
+	case ULTRASOUND_SAMPLE_OUT_OF_RANGE:
+		if (sample->echo_us < ULTRASOUND_MIN_RANGE_US)
+		{
+			/* Closer than the sensor can resolve */
+			initialize_range_tracker(&pipeline_trackers[sensor]);
+			pipeline_lead_mm[sensor] = 0;
+			break;
+		}
+		/* Beyond the rated range, the same as no echo at all */
+		/* fall through */
+	default:
+		initialize_range_tracker(&pipeline_trackers[sensor]);
+		pipeline_lead_mm[sensor] = NO_OBJECT_MM;
+		break;
+	}
+}
+
+void update_alert(uint8_t lost_sensors, uint64_t timestamp_us)
+{
+	alert_pipeline_telemetry_t record;
+	alert_pipeline_event_t event;
+	uint8_t nearest_sensor = pipeline_status.nearest_sensor;
+	uint8_t previous_state = alert_machine.current_state->state;
+	uint8_t sensor;
+	int32_t distance_mm;
+	uint32_t update_cycles;
+
+	/* The nearest object of any sensor drives the alert */
+	alert_params.signals[DISTANCE_SIGNAL] = INT32_MAX;
+	for (sensor = 0; sensor < ULTRASOUND_SENSOR_COUNT; sensor++)
+	{
+		/* A sensor yet to publish has no range, until it times out as lost */
+		if (!(lost_sensors & (1U << sensor)) && pipeline_samples[sensor].sequence == 0) continue;
+
+		distance_mm = (lost_sensors & (1U << sensor)) ? LOST_SENSOR_MM : pipeline_lead_mm[sensor];
+		if (distance_mm < alert_params.signals[DISTANCE_SIGNAL])
+		{
+			alert_params.signals[DISTANCE_SIGNAL] = distance_mm;
+			nearest_sensor = sensor;
+		}
+	}
+	alert_params.signals[VELOCITY_SIGNAL] = pipeline_trackers[nearest_sensor].rate_mm_s;
+	alert_params.signals[TIME_TO_COLLISION_SIGNAL] =
+		(pipeline_trackers[nearest_sensor].time_to_collision_ms > INT32_MAX)
+		? INT32_MAX : (int32_t)pipeline_trackers[nearest_sensor].time_to_collision_ms;
+	alert_params.signals[SENSOR_SIGNAL] = nearest_sensor;
+	alert_params.signals[SAMPLE_AGE_SIGNAL] =
+		(uint32_t)(get_timestamp_us() - pipeline_samples[nearest_sensor].timestamp_us) / 1000;
+	/* Dwells are timed on a clock that never runs backwards */
+	if (timestamp_us > alert_params.timestamp_us) alert_params.timestamp_us = timestamp_us;
+
+	update_cycles = DWT->CYCCNT;
+	update_state_machine(&alert_machine, &alert_params);
+	update_cycles = DWT->CYCCNT - update_cycles;
+
+	record.timestamp_us = timestamp_us;
+	record.distance_mm = alert_params.signals[DISTANCE_SIGNAL];
+	record.rate_mm_s = alert_params.signals[VELOCITY_SIGNAL];
+	/* From the end of the echo to the state machine having acted */
+	record.latency_us = (uint32_t)(get_timestamp_us() - timestamp_us);
+	record.update_cycles = update_cycles;
+	record.sensor = nearest_sensor;
+	record.state = alert_machine.current_state->state;
+	push_spsc_ring(&telemetry_queue, &record);
+
+	if (record.state != previous_state)
+	{
+		event.timestamp_us = record.timestamp_us;
+		event.distance_mm = record.distance_mm;
+		event.sensor = nearest_sensor;
+		event.from = previous_state;
+		event.to = record.state;
+		push_spsc_ring(&event_queue, &event);
+	}
+	publish_status(&record, lost_sensors);
+}
+
+void publish_status(const alert_pipeline_telemetry_t* record, uint8_t lost_sensors)
+{
+	alert_pipeline_status_t* status = &pipeline_status;
+	uint32_t filter_cycles = pipeline_filters[record->sensor].max_cycles;
+
+	status_lock++;
+	__DMB();
+	status->sequence++;
+	status->state = record->state;
+	status->distance_mm = record->distance_mm;
+	status->nearest_sensor = record->sensor;
+	status->lost_sensors = lost_sensors;
+	status->latency_us = record->latency_us;
+	if (record->latency_us > status->max_latency_us) status->max_latency_us = record->latency_us;
+	if (filter_cycles > status->max_filter_cycles) status->max_filter_cycles = filter_cycles;
+	if (record->update_cycles > status->max_update_cycles)
+	{
+		status->max_update_cycles = record->update_cycles;
+	}
+	status->event_drops = get_spsc_ring_drops(&event_queue);
+	status->telemetry_drops = get_spsc_ring_drops(&telemetry_queue);
+	__DMB();
+	status_lock++;
+}
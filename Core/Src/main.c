@@ -27,9 +27,13 @@
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
 #include <stdio.h>
-#include <ultrasound_backup_state_machine.h>
 #include "ultrasound.h"
-#include "state_machine.h"
+#include "timestamp.h"
+#include "alert_pipeline.h"
+#include "scheduler.h"
+#include "activity.h"
+#include "telemetry.h"
+#include "ultrasound_backup_state_machine.h"
 /* USER CODE END Includes */
 
 /* Private typedef -----------------------------------------------------------*/
@@ -39,6 +43,16 @@
 
 /* Private define ------------------------------------------------------------*/
 /* USER CODE BEGIN PD */
+/* Time in ms between status reports, echoes drive the alert on their own */
+#define REPORT_PERIOD_MS 100
+
+/* Time in ms between task statistics reports */
+#define STATS_PERIOD_MS 1000
+
+/* Task priorities, lower runs first */
+#define FLASH_TASK_PRIORITY 0
+#define REPORT_TASK_PRIORITY 1
+#define STATS_TASK_PRIORITY 2
 /* USER CODE END PD */
 
 /* Private macro -------------------------------------------------------------*/
@@ -49,12 +63,17 @@
 /* Private variables ---------------------------------------------------------*/
 
 /* USER CODE BEGIN PV */
+char buffer[64] = { 0 };
+alert_pipeline_status_t status = { 0 };
+uint8_t reported_lost_sensors = 0;
 
 /* USER CODE END PV */
 
 /* Private function prototypes -----------------------------------------------*/
 void SystemClock_Config(void);
 /* USER CODE BEGIN PFP */
+void report_task(void);
+void stats_task(void);
 
 /* USER CODE END PFP */
 
@@ -86,6 +105,8 @@ int main(void)
   SystemClock_Config();
 
   /* USER CODE BEGIN SysInit */
+  initialize_timestamp();
+  initialize_activity();
 
   /* USER CODE END SysInit */
 
@@ -96,32 +117,36 @@ int main(void)
   MX_TIM5_Init();
   MX_USART2_UART_Init();
   /* USER CODE BEGIN 2 */
-   enable_ultrasound();
-  state_t current_state = initialize_state_machine(my_state_machine_config);
+  initialize_telemetry();
+  /* The pipeline is ready before the first echo can pend PendSV */
+  initialize_alert_pipeline();
+  enable_ultrasound();
+  initialize_scheduler();
+  add_scheduler_task(flash_critical_alert, CRITICAL_ALERT_FLASH_MS * 1000,
+	  SCHEDULER_PERIOD_DEADLINE, FLASH_TASK_PRIORITY);
+  add_scheduler_task(report_task, REPORT_PERIOD_MS * 1000,
+	  SCHEDULER_PERIOD_DEADLINE, REPORT_TASK_PRIORITY);
+  add_scheduler_task(stats_task, STATS_PERIOD_MS * 1000,
+	  SCHEDULER_PERIOD_DEADLINE, STATS_TASK_PRIORITY);
   /* USER CODE END 2 */
 
   /* Infinite loop */
   /* USER CODE BEGIN WHILE */
-  uint32_t size = 0;
-  char dist_str[] = "Distance: %d\n\r";
-  char state_str[] = "State: %d\n\r";
-  char buffer[32] = { 0 };
-  state_machine_params_t params =
-  {
-	.distance = 400
-  };
+#if INTERRUPT_DRIVEN_MODE
+  /* Everything runs in interrupts from here on, the core sleeps in between */
+  start_scheduler();
+  HAL_PWR_EnableSleepOnExit();
+  exit_activity();
+  HAL_PWR_EnterSLEEPMode(PWR_MAINREGULATOR_ON, PWR_SLEEPENTRY_WFI);
+#else
+  /* Tasks run to completion and the core sleeps in between */
+  run_scheduler();
+#endif
   while (1)
   {
-	  params.distance = get_read_cm();
-	  current_state = update_state_machine(params);
-	  size = snprintf(buffer, 32, dist_str, params.distance);
-	  HAL_UART_Transmit(&huart2, (uint8_t *)buffer, size, 0xFFFF);
-	  size = snprintf(buffer, 32, state_str, current_state);
-	  HAL_UART_Transmit(&huart2, (uint8_t *)buffer, size, 0xFFFF);
     /* USER CODE END WHILE */
 
     /* USER CODE BEGIN 3 */
-	  HAL_Delay(100);
   }
   /* USER CODE END 3 */
 }
@@ -182,6 +207,91 @@ void SystemClock_Config(void)
 }
 
 /* USER CODE BEGIN 4 */
+/** Reports the alert over UART.
+ *
+ * Only queues the report, the telemetry DMA sends it after the task ends.
+ *
+ * Also requests a pipeline run, since lost sensors stop echoing and only
+ * a requested run notices them.
+ */
+void report_task(void)
+{
+  char event_str[] = "State: %u -> %u at %ld mm\n\r";
+  char record_str[] = "S%u %ld mm %ld mm/s %lu us\n\r";
+  char lost_str[] = "Sensor %d lost\n\r";
+  alert_pipeline_event_t event;
+  alert_pipeline_telemetry_t record;
+  uint32_t size = 0;
+  uint8_t sensor = 0;
+
+  request_alert_pipeline();
+  while (read_alert_pipeline_events(&event, 1))
+  {
+	  size = snprintf(buffer, sizeof(buffer), event_str, event.from, event.to, (long)event.distance_mm);
+	  write_telemetry(buffer, size);
+  }
+  while (read_alert_pipeline_telemetry(&record, 1))
+  {
+	  size = snprintf(buffer, sizeof(buffer), record_str, record.sensor, (long)record.distance_mm,
+		  (long)record.rate_mm_s, (unsigned long)record.latency_us);
+	  write_telemetry(buffer, size);
+  }
+  get_alert_pipeline_status(&status, status.sequence);
+  for (sensor = 0; sensor < ULTRASOUND_SENSOR_COUNT; sensor++)
+  {
+	  if ((status.lost_sensors & ~reported_lost_sensors) & (1U << sensor))
+	  {
+		  size = snprintf(buffer, sizeof(buffer), lost_str, sensor);
+		  write_telemetry(buffer, size);
+	  }
+  }
+  reported_lost_sensors = status.lost_sensors;
+}
+
+void stats_task(void)
+{
+  char task_str[] = "Task %u: %lu cycles, %lu missed\n\r";
+  char latency_str[] = "Latency: %lu us\n\r";
+  char filter_str[] = "Filter: %lu cycles\n\r";
+  char update_str[] = "Update: %lu cycles\n\r";
+  char drops_str[] = "Drops: %lu %lu %lu %lu\n\r";
+  char activity_str[] = "Active: %lu.%lu %%, %lu wakes/s\n\r";
+  scheduler_task_stats_t stats;
+  activity_stats_t activity;
+  uint32_t active_permille = 0;
+  uint32_t wakes_per_s = 0;
+  uint32_t size = 0;
+  uint8_t task = 0;
+
+  for (task = 0; task < get_scheduler_task_count(); task++)
+  {
+	  get_scheduler_task_stats(task, &stats);
+	  size = snprintf(buffer, sizeof(buffer), task_str, task,
+		  (unsigned long)stats.max_cycles, (unsigned long)stats.deadline_misses);
+	  write_telemetry(buffer, size);
+  }
+  get_alert_pipeline_status(&status, status.sequence);
+  size = snprintf(buffer, sizeof(buffer), latency_str, (unsigned long)status.max_latency_us);
+  write_telemetry(buffer, size);
+  size = snprintf(buffer, sizeof(buffer), filter_str, (unsigned long)status.max_filter_cycles);
+  write_telemetry(buffer, size);
+  size = snprintf(buffer, sizeof(buffer), update_str, (unsigned long)status.max_update_cycles);
+  write_telemetry(buffer, size);
+  /* Samples, alert changes, telemetry records and UART reports lost to full queues */
+  size = snprintf(buffer, sizeof(buffer), drops_str, (unsigned long)get_ultrasound_sample_drops(),
+	  (unsigned long)status.event_drops, (unsigned long)status.telemetry_drops,
+	  (unsigned long)get_telemetry_drops());
+  write_telemetry(buffer, size);
+  read_activity(&activity);
+  if (activity.elapsed_us > 0)
+  {
+	  active_permille = (uint32_t)((uint64_t)activity.active_us * 1000 / activity.elapsed_us);
+	  wakes_per_s = (uint32_t)((uint64_t)activity.wakes * 1000000 / activity.elapsed_us);
+  }
+  size = snprintf(buffer, sizeof(buffer), activity_str, (unsigned long)(active_permille / 10),
+	  (unsigned long)(active_permille % 10), (unsigned long)wakes_per_s);
+  write_telemetry(buffer, size);
+}
 
 /* USER CODE END 4 */
 
@@ -0,0 +1,107 @@
+#include "range_filter.h"
+
+#if RANGE_FILTER_WINDOW != 3 && RANGE_FILTER_WINDOW != 5
+#error "RANGE_FILTER_WINDOW must be 3 or 5"
+#endif
+
+/* Private Defines */
+
+/* Puts a and b in ascending order */
+#define SORT_PAIR(a, b) \
+	do \
+	{ \
+		if ((a) > (b)) \
+		{ \
+			int32_t swap = (a); \
+			(a) = (b); \
+			(b) = swap; \
+		} \
+	} while (0)
+
+/* Private Functions */
+
+/** Finds the median of a window with a sorting network.
+ *
+ * Only sorts as far as the middle element needs, 3 compares for a window of
+ * 3 and 7 for a window of 5.
+ *
+ * @params window The values, reordered in place.
+ * @returns The median value.
+ */
+int32_t median_of_window(int32_t window[RANGE_FILTER_WINDOW]);
+
+/* Public Function Implementations */
+
+void initialize_range_filter(range_filter_t* filter)
+{
+	filter->next = 0;
+	filter->count = 0;
+	filter->last_cycles = 0;
+	filter->max_cycles = 0;
+}
+
+int32_t update_range_filter(range_filter_t* filter, int32_t distance_mm)
+{
+	uint32_t start_cycles = DWT->CYCCNT;
+	int32_t sorted[RANGE_FILTER_WINDOW];
+	int32_t filtered_mm = distance_mm;
+	int32_t median_mm;
+#if RANGE_FILTER_MODE == RANGE_FILTER_HAMPEL
+	int32_t deviation_mm;
+	int32_t threshold_mm;
+#endif
+	uint8_t i;
+
+	filter->window[filter->next] = distance_mm;
+	filter->next = (filter->next + 1) % RANGE_FILTER_WINDOW;
+	if (filter->count < RANGE_FILTER_WINDOW) filter->count++;
+
+	if (filter->count == RANGE_FILTER_WINDOW)
+	{
+		for (i = 0; i < RANGE_FILTER_WINDOW; i++) sorted[i] = filter->window[i];
+		median_mm = median_of_window(sorted);
+#if RANGE_FILTER_MODE == RANGE_FILTER_HAMPEL
+		for (i = 0; i < RANGE_FILTER_WINDOW; i++)
+		{
+			deviation_mm = filter->window[i] - median_mm;
+			sorted[i] = (deviation_mm < 0) ? -deviation_mm : deviation_mm;
+		}
+		/* 1.5 MAD approximates the 1.4826 MAD estimate of a deviation */
+		deviation_mm = median_of_window(sorted);
+		threshold_mm = RANGE_FILTER_HAMPEL_MADS * (deviation_mm + deviation_mm / 2);
+		if (threshold_mm < RANGE_FILTER_HAMPEL_MIN_MM) threshold_mm = RANGE_FILTER_HAMPEL_MIN_MM;
+
+		deviation_mm = distance_mm - median_mm;
+		if (deviation_mm > threshold_mm || -deviation_mm > threshold_mm)
+		{
+			filtered_mm = median_mm;
+		}
+#else
+		filtered_mm = median_mm;
+#endif
+	}
+
+	filter->last_cycles = DWT->CYCCNT - start_cycles;
+	if (filter->last_cycles > filter->max_cycles) filter->max_cycles = filter->last_cycles;
+	return filtered_mm;
+}
+
+/* Private Function Implementations */
+
+int32_t median_of_window(int32_t window[RANGE_FILTER_WINDOW])
+{
+#if RANGE_FILTER_WINDOW == 3
+	SORT_PAIR(window[0], window[1]);
+	SORT_PAIR(window[1], window[2]);
+	SORT_PAIR(window[0], window[1]);
+#else
+	SORT_PAIR(window[0], window[1]);
+	SORT_PAIR(window[3], window[4]);
+	SORT_PAIR(window[0], window[3]);
+	SORT_PAIR(window[1], window[4]);
+	SORT_PAIR(window[1], window[2]);
+	SORT_PAIR(window[2], window[3]);
+	SORT_PAIR(window[1], window[2]);
+#endif
+	return window[RANGE_FILTER_WINDOW / 2];
+}
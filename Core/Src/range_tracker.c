@@ -0,0 +1,68 @@
+#include "range_tracker.h"
+
+/* Public Function Implementations */
+
+void initialize_range_tracker(range_tracker_t* tracker)
+{
+	tracker->range_um = 0;
+	tracker->rate_mm_s = 0;
+	tracker->time_to_collision_ms = RANGE_TRACKER_NO_COLLISION;
+	tracker->last_timestamp_us = 0;
+	tracker->is_tracking = 0;
+}
+
+void update_range_tracker(
+	range_tracker_t* tracker,
+	int32_t distance_mm,
+	uint64_t timestamp_us
+)
+{
+	uint64_t gap_us = timestamp_us - tracker->last_timestamp_us;
+	int32_t measured_um = distance_mm * 1000;
+	int32_t predicted_um;
+	int32_t residual_um;
+	int32_t gap_100us;
+
+	tracker->last_timestamp_us = timestamp_us;
+
+	/* Start a new track on the first sample or after a dropout */
+	if (!tracker->is_tracking || gap_us > RANGE_TRACKER_MAX_GAP_US || gap_us < 100)
+	{
+		tracker->range_um = measured_um;
+		tracker->rate_mm_s = 0;
+		tracker->time_to_collision_ms = RANGE_TRACKER_NO_COLLISION;
+		tracker->is_tracking = 1;
+		return;
+	}
+
+	/* um/ms times 100 us steps stays in 32 bits for any gap up to the max */
+	gap_100us = (int32_t)((uint32_t)gap_us / 100);
+	predicted_um = tracker->range_um + tracker->rate_mm_s * gap_100us / 10;
+	residual_um = measured_um - predicted_um;
+
+	tracker->range_um = predicted_um
+		+ (int32_t)(((int64_t)RANGE_TRACKER_ALPHA_Q16 * residual_um) >> 16);
+	tracker->rate_mm_s += (int32_t)(((int64_t)RANGE_TRACKER_BETA_Q16
+		* (residual_um * 10 / gap_100us)) >> 16);
+
+	if (tracker->rate_mm_s < 0 && tracker->range_um > 0)
+	{
+		/* um over um/ms */
+		tracker->time_to_collision_ms = (uint32_t)(tracker->range_um / -tracker->rate_mm_s);
+	}
+	else
+	{
+		tracker->time_to_collision_ms = RANGE_TRACKER_NO_COLLISION;
+	}
+}
+
+int32_t get_range_tracker_lead_mm(const range_tracker_t* tracker, uint32_t lead_ms)
+{
+	int32_t lead_um;
+
+	/* Only look ahead for an object closing in */
+	if (tracker->rate_mm_s >= 0) return tracker->range_um / 1000;
+
+	lead_um = tracker->range_um + tracker->rate_mm_s * (int32_t)lead_ms;
+	return (lead_um > 0) ? lead_um / 1000 : 0;
+}
@@ -0,0 +1,403 @@
+#include "scheduler.h"
+#include "timestamp.h"
+#include "activity.h"
+
+/* Private Typedefs */
+
+/** Scheduler task
+ *
+ * release_us: Next release of a periodic task, only ever moved on by whole
+ * periods.
+ * signal_us: Time of the pending signal.
+ * is_signalled: Set by signal_scheduler_task() until the task runs.
+ */
+typedef struct
+{
+	scheduler_task_func_t func;
+	uint32_t period_us;
+	uint32_t deadline_us;
+	uint8_t priority;
+	uint64_t release_us;
+	uint64_t signal_us;
+	volatile uint8_t is_signalled;
+	scheduler_task_stats_t stats;
+} scheduler_task_t;
+
+/* Private Variables */
+
+scheduler_task_t tasks[SCHEDULER_MAX_TASKS];
+uint8_t task_count = 0;
+
+/* Times the scheduler sleeps */
+TIM_HandleTypeDef htim6;
+
+/* Slept time in us that does not make up a whole HAL tick yet */
+uint32_t sleep_remainder_us = 0;
+
+/* HAL tick at timestamp 0, once the HAL tick follows the timestamp clock */
+uint32_t tick_offset_ms = 0;
+uint8_t is_tick_from_timestamp = 0;
+
+/* TIM6 count and cycle count the timestamp was last caught up to, once
+ * dispatch_scheduler() times the sleep with TIM6 */
+uint32_t sleep_timer_us = 0;
+uint32_t sleep_cycles = 0;
+uint8_t is_sleep_timed = 0;
+
+/* Private Functions */
+
+/** Finds the task to run next.
+ *
+ * @params now_us The current time.
+ * @params next_release_us Filled with the earliest periodic release still
+ * to come if no task is ready.
+ * @returns The task, or SCHEDULER_NO_TASK if none is ready.
+ */
+uint8_t find_ready_task(uint64_t now_us, uint64_t* next_release_us);
+
+/** Finds the earliest release of a task still waiting for a run.
+ *
+ * A due periodic release and a signal can both be pending, one run serves
+ * both. Must be called with interrupts masked.
+ *
+ * @params task The task to check.
+ * @params now_us The current time.
+ * @params release_us Filled with the earliest pending release.
+ * @returns 1 if a release is pending, otherwise 0.
+ */
+uint8_t get_pending_release(const scheduler_task_t* task, uint64_t now_us, uint64_t* release_us);
+
+/** Runs a task once and updates its statistics.
+ *
+ * @params task The task to run.
+ * @params now_us The time the task was picked.
+ */
+void run_task(uint8_t task, uint64_t now_us);
+
+/** Sleeps until the next release or an interrupt.
+ *
+ * @params sleep_us The time to the next release.
+ */
+void sleep_until_release(uint64_t sleep_us);
+
+/* Public Function Implementations */
+
+void initialize_scheduler()
+{
+	task_count = 0;
+	sleep_remainder_us = 0;
+	is_sleep_timed = 0;
+
+	/* TIM6 counts microseconds and stops at its update event */
+	__HAL_RCC_TIM6_CLK_ENABLE();
+	htim6.Instance = TIM6;
+	htim6.Init.Prescaler = SystemCoreClock / 1000000 - 1;
+	htim6.Init.CounterMode = TIM_COUNTERMODE_UP;
+	htim6.Init.Period = SCHEDULER_MAX_SLEEP_US - 1;
+	htim6.Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
+	htim6.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_DISABLE;
+	if (HAL_TIM_Base_Init(&htim6) != HAL_OK)
+	{
+		Error_Handler();
+	}
+	htim6.Instance->CR1 |= TIM_CR1_OPM;
+	__HAL_TIM_CLEAR_FLAG(&htim6, TIM_FLAG_UPDATE);
+	__HAL_TIM_ENABLE_IT(&htim6, TIM_IT_UPDATE);
+	HAL_NVIC_SetPriority(TIM6_DAC_IRQn, TASK_IRQ_PRIORITY, 0);
+	HAL_NVIC_EnableIRQ(TIM6_DAC_IRQn);
+}
+
+uint8_t add_scheduler_task(
+	scheduler_task_func_t func,
+	uint32_t period_us,
+	uint32_t deadline_us,
+	uint8_t priority
+)
+{
+	scheduler_task_t* task;
+
+	/* An event task has no period its deadline could default to */
+	if (task_count >= SCHEDULER_MAX_TASKS ||
+			(period_us == SCHEDULER_EVENT_TASK && deadline_us == SCHEDULER_PERIOD_DEADLINE))
+	{
+		Error_Handler();
+		return SCHEDULER_NO_TASK;
+	}
+
+	task = &tasks[task_count];
+	task->func = func;
+	task->period_us = period_us;
+	task->deadline_us = (deadline_us != SCHEDULER_PERIOD_DEADLINE) ? deadline_us : period_us;
+	task->priority = priority;
+	task->release_us = get_timestamp_us() + period_us;
+	task->signal_us = 0;
+	task->is_signalled = 0;
+	task->stats = (scheduler_task_stats_t){0};
+	return task_count++;
+}
+
+void signal_scheduler_task(uint8_t task)
+{
+	uint32_t primask = __get_PRIMASK();
+
+	if (task >= task_count) return;
+
+	__disable_irq();
+	if (!tasks[task].is_signalled)
+	{
+		tasks[task].signal_us = get_timestamp_us();
+		tasks[task].is_signalled = 1;
+	}
+	__set_PRIMASK(primask);
+#if INTERRUPT_DRIVEN_MODE
+	HAL_NVIC_SetPendingIRQ(TIM6_DAC_IRQn);
+#endif
+}
+
+void run_scheduler()
+{
+	uint64_t now_us;
+	uint64_t next_release_us;
+	uint8_t task;
+
+	while (1)
+	{
+		now_us = get_timestamp_us();
+		task = find_ready_task(now_us, &next_release_us);
+		if (task != SCHEDULER_NO_TASK)
+		{
+			run_task(task, now_us);
+		}
+		else if (next_release_us - now_us >= SCHEDULER_MIN_SLEEP_US)
+		{
+			sleep_until_release(next_release_us - now_us);
+		}
+	}
+}
+
+void start_scheduler()
+{
+#if SCHEDULER_TICKLESS
+	__disable_irq();
+	HAL_SuspendTick();
+	tick_offset_ms = uwTick - (uint32_t)(get_timestamp_us() / 1000);
+	is_tick_from_timestamp = 1;
+	__enable_irq();
+#endif
+	HAL_NVIC_SetPendingIRQ(TIM6_DAC_IRQn);
+}
+
+void dispatch_scheduler()
+{
+	uint64_t now_us;
+	uint64_t next_release_us;
+	uint8_t task;
+
+	__HAL_TIM_DISABLE(&htim6);
+	__HAL_TIM_CLEAR_FLAG(&htim6, TIM_FLAG_UPDATE);
+	while (1)
+	{
+		now_us = get_timestamp_us();
+		task = find_ready_task(now_us, &next_release_us);
+		if (task != SCHEDULER_NO_TASK)
+		{
+			run_task(task, now_us);
+		}
+		else if (next_release_us - now_us >= SCHEDULER_MIN_SLEEP_US)
+		{
+			break;
+		}
+	}
+
+	/* A signal from here on pends this interrupt again */
+	__HAL_TIM_SET_COUNTER(&htim6, 0);
+	__HAL_TIM_SET_AUTORELOAD(&htim6, (uint32_t)(next_release_us - now_us) - 1);
+	sleep_timer_us = 0;
+	sleep_cycles = DWT->CYCCNT;
+	is_sleep_timed = 1;
+	__HAL_TIM_ENABLE(&htim6);
+}
+
+#if INTERRUPT_DRIVEN_MODE
+/* The cycle counter stops whenever the core sleeps between handlers, so
+ * every wake catches the timestamp up on TIM6 before the handler reads it */
+void activity_wake_callback()
+{
+	uint32_t cycles_per_us = SystemCoreClock / 1000000;
+	uint32_t timer_us;
+	uint32_t counted_us;
+
+	if (!is_sleep_timed) return;
+
+	/* One-pulse mode leaves the counter at 0 once the update fired */
+	timer_us = __HAL_TIM_GET_FLAG(&htim6, TIM_FLAG_UPDATE) ?
+		__HAL_TIM_GET_AUTORELOAD(&htim6) + 1 : __HAL_TIM_GET_COUNTER(&htim6);
+	counted_us = (DWT->CYCCNT - sleep_cycles) / cycles_per_us;
+	if (timer_us - sleep_timer_us > counted_us)
+	{
+		advance_timestamp(timer_us - sleep_timer_us - counted_us);
+	}
+	sleep_timer_us = timer_us;
+	/* Cycles short of a whole microsecond carry over to the next wake */
+	sleep_cycles += counted_us * cycles_per_us;
+}
+#endif
+
+#if INTERRUPT_DRIVEN_MODE && SCHEDULER_TICKLESS
+/* SysTick stays suspended after start_scheduler(), so the HAL tick is taken
+ * from the timestamp clock from then on */
+uint32_t HAL_GetTick(void)
+{
+	if (!is_tick_from_timestamp) return uwTick;
+
+	return tick_offset_ms + (uint32_t)(get_timestamp_us() / 1000);
+}
+#endif
+
+void get_scheduler_task_stats(uint8_t task, scheduler_task_stats_t* stats)
+{
+	if (task >= task_count) return;
+
+	*stats = tasks[task].stats;
+}
+
+uint8_t get_scheduler_task_count()
+{
+	return task_count;
+}
+
+/* Private Function Implementations */
+
+uint8_t find_ready_task(uint64_t now_us, uint64_t* next_release_us)
+{
+	uint32_t primask = __get_PRIMASK();
+	uint8_t ready = SCHEDULER_NO_TASK;
+	uint64_t ready_deadline_us = 0;
+	uint64_t release_us;
+	uint64_t deadline_us;
+	uint8_t task;
+
+	*next_release_us = now_us + SCHEDULER_MAX_SLEEP_US;
+	__disable_irq();
+	for (task = 0; task < task_count; task++)
+	{
+		if (!get_pending_release(&tasks[task], now_us, &release_us))
+		{
+			/* Not ready, but may bound the sleep */
+			if (tasks[task].period_us != SCHEDULER_EVENT_TASK &&
+					tasks[task].release_us < *next_release_us)
+			{
+				*next_release_us = tasks[task].release_us;
+			}
+			continue;
+		}
+
+		deadline_us = release_us + tasks[task].deadline_us;
+		if (ready == SCHEDULER_NO_TASK || tasks[task].priority < tasks[ready].priority ||
+				(tasks[task].priority == tasks[ready].priority && deadline_us < ready_deadline_us))
+		{
+			ready = task;
+			ready_deadline_us = deadline_us;
+		}
+	}
+	__set_PRIMASK(primask);
+	return ready;
+}
+
+uint8_t get_pending_release(const scheduler_task_t* task, uint64_t now_us, uint64_t* release_us)
+{
+	uint8_t is_released = (task->period_us != SCHEDULER_EVENT_TASK && task->release_us <= now_us);
+
+	if (is_released && (!task->is_signalled || task->release_us <= task->signal_us))
+	{
+		*release_us = task->release_us;
+		return 1;
+	}
+	*release_us = task->signal_us;
+	return task->is_signalled;
+}
+
+void run_task(uint8_t task, uint64_t now_us)
+{
+	scheduler_task_t* state = &tasks[task];
+	uint32_t primask = __get_PRIMASK();
+	uint64_t release_us;
+	uint64_t deadline_us;
+	uint32_t cycles;
+
+	__disable_irq();
+	get_pending_release(state, now_us, &release_us);
+	deadline_us = release_us + state->deadline_us;
+
+	/* A signal during the run releases the task again */
+	state->is_signalled = 0;
+	if (state->period_us != SCHEDULER_EVENT_TASK && state->release_us <= now_us)
+	{
+		/* Releases that passed while the task was late are skipped */
+		state->release_us += state->period_us;
+		while (state->release_us <= now_us)
+		{
+			state->release_us += state->period_us;
+			state->stats.deadline_misses++;
+		}
+	}
+	__set_PRIMASK(primask);
+
+	cycles = DWT->CYCCNT;
+	state->func();
+	cycles = DWT->CYCCNT - cycles;
+
+	state->stats.runs++;
+	state->stats.last_cycles = cycles;
+	state->stats.total_cycles += cycles;
+	if (cycles > state->stats.max_cycles) state->stats.max_cycles = cycles;
+	if (get_timestamp_us() > deadline_us) state->stats.deadline_misses++;
+}
+
+void sleep_until_release(uint64_t sleep_us)
+{
+	uint64_t next_release_us;
+	uint32_t slept_us;
+	uint32_t counted_us;
+	uint32_t cycles;
+
+	if (sleep_us > SCHEDULER_MAX_SLEEP_US) sleep_us = SCHEDULER_MAX_SLEEP_US;
+
+	/* Interrupts wake the core but only run once the clocks are caught up */
+	__disable_irq();
+	if (find_ready_task(get_timestamp_us(), &next_release_us) != SCHEDULER_NO_TASK)
+	{
+		/* An interrupt signalled a task since it was last checked */
+		__enable_irq();
+		return;
+	}
+#if SCHEDULER_TICKLESS
+	HAL_SuspendTick();
+#endif
+	__HAL_TIM_SET_COUNTER(&htim6, 0);
+	__HAL_TIM_SET_AUTORELOAD(&htim6, (uint32_t)sleep_us - 1);
+	__HAL_TIM_CLEAR_FLAG(&htim6, TIM_FLAG_UPDATE);
+	__HAL_TIM_ENABLE(&htim6);
+	exit_activity();
+	cycles = DWT->CYCCNT;
+	__DSB();
+	__WFI();
+	cycles = DWT->CYCCNT - cycles;
+	__HAL_TIM_DISABLE(&htim6);
+	slept_us = __HAL_TIM_GET_FLAG(&htim6, TIM_FLAG_UPDATE) ?
+		(uint32_t)sleep_us : __HAL_TIM_GET_COUNTER(&htim6);
+	__HAL_TIM_CLEAR_FLAG(&htim6, TIM_FLAG_UPDATE);
+	HAL_NVIC_ClearPendingIRQ(TIM6_DAC_IRQn);
+
+	/* The cycle counter stops while the core sleeps */
+	counted_us = cycles / (SystemCoreClock / 1000000);
+	if (slept_us > counted_us) advance_timestamp(slept_us - counted_us);
+#if SCHEDULER_TICKLESS
+	sleep_remainder_us += slept_us;
+	uwTick += sleep_remainder_us / 1000;
+	sleep_remainder_us %= 1000;
+	HAL_ResumeTick();
+#endif
+	enter_activity();
+	__enable_irq();
+}
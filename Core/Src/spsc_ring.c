@@ -0,0 +1,68 @@
+#include <string.h>
+#include "spsc_ring.h"
+
+/* Public Function Implementations */
+
+void initialize_spsc_ring(
+	spsc_ring_t* ring,
+	void* buffer,
+	uint32_t element_size,
+	uint32_t capacity
+)
+{
+	if (!SPSC_RING_IS_POWER_OF_TWO(capacity))
+	{
+		Error_Handler();
+		return;
+	}
+
+	ring->buffer = buffer;
+	ring->element_size = element_size;
+	ring->mask = capacity - 1;
+	ring->head = 0;
+	ring->tail = 0;
+	ring->drops = 0;
+}
+
+uint8_t push_spsc_ring(spsc_ring_t* ring, const void* element)
+{
+	uint32_t head = ring->head;
+
+	/* Unsigned subtraction is correct across a wrap of either index */
+	if (head - ring->tail > ring->mask)
+	{
+		ring->drops++;
+		return 0;
+	}
+
+	memcpy(&ring->buffer[(head & ring->mask) * ring->element_size], element, ring->element_size);
+	/* The element must be complete before the head hands it over */
+	__DMB();
+	ring->head = head + 1;
+	return 1;
+}
+
+uint8_t pop_spsc_ring(spsc_ring_t* ring, void* element)
+{
+	uint32_t tail = ring->tail;
+
+	if (ring->head == tail) return 0;
+
+	/* The element must not be read ahead of the head that published it */
+	__DMB();
+	memcpy(element, &ring->buffer[(tail & ring->mask) * ring->element_size], ring->element_size);
+	/* The element must be copied out before its slot is handed back */
+	__DMB();
+	ring->tail = tail + 1;
+	return 1;
+}
+
+uint32_t get_spsc_ring_count(const spsc_ring_t* ring)
+{
+	return ring->head - ring->tail;
+}
+
+uint32_t get_spsc_ring_drops(const spsc_ring_t* ring)
+{
+	return ring->drops;
+}
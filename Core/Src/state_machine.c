@@ -1,6 +1,14 @@
 #include "state_machine.h"
 #include "tim.h"
 
+/* Private Defines */
+
+/* Marks a band in which no transition of the state holds */
+#define BAND_NO_TRANSITION 0xFF
+
+/* Marks a band in which the transition holds without checking its guards */
+#define BAND_DIRECT 0x80
+
 /* Constants */
 const state_machine_transition_t STATE_MACHINE_TRANSITION_TERMINATOR =
 	STATE_MACHINE_TRANSITION_TERMINATOR_DECL;
@@ -13,42 +21,107 @@ const state_machine_transition_t STATE_MACHINE_TRANSITION_TERMINATOR =
  */
 typedef struct
 {
-	state_machine_state_t* next_state;
-	state_machine_transition_t triggering_transition;
+	const state_machine_state_t* next_state;
+	const state_machine_transition_t* triggering_transition;
 } transition_t;
 
-/** Internal hysteresis configuration type
+/* Private Functions */
+
+/** Finds the next state based on the given parameters.
  *
- * Contains information about how to handle the hysteresis.
+ * @params machine The state machine.
+ * @params params The update parameters.
+ * @params next_state Filled with a transition if required. Otherwise the
+ * current state and terminator.
  */
-typedef struct
-{
-	uint32_t hysteresis;
-	state_machine_state_enum_t returning_state;
-	state_machine_transition_t triggered_transition;
-} state_machine_hysteresis_config_t;
+void find_next_state(
+	const state_machine_t* machine,
+	const state_machine_params_t* params,
+	transition_t* next_state
+);
 
-/* Private Variables */
-state_machine_state_t* previous_state = NULL;
-state_machine_state_t* current_state = NULL;
-state_machine_hysteresis_config_t hysteresis_config =
-{
-	.hysteresis = HYSTERESIS_DISABLED,
-	.returning_state = INVALID_STATE,
-	.triggered_transition = STATE_MACHINE_TRANSITION_TERMINATOR_DECL,
-};
+/** Runs one update of a state machine.
+ *
+ * @params machine An initialized state machine.
+ * @params params The update parameters.
+ * @params run_actions 0 to only move between states, without running any
+ * hooks or transition functions.
+ * @returns The transition taken, or NULL if none was.
+ */
+const state_machine_transition_t* step_state_machine(
+	state_machine_t* machine,
+	const state_machine_params_t* params,
+	uint8_t run_actions
+);
 
-/* Primary object for this state machine */
-state_machine_state_t** state_machine = NULL;
+/** Leaves the previous state and enters the next one.
+ *
+ * Runs the exit hooks of the previous state and its ancestors up to the
+ * first one shared with the next state, the transition function, and then
+ * the enter hooks down to the next state.
+ *
+ * @params machine The state machine.
+ * @params previous_state Where the state to leave is held.
+ * @params next_state The transition that was found.
+ */
+void change_state(
+	state_machine_t* machine,
+	const state_machine_state_t* const* previous_state,
+	const transition_t* next_state
+);
 
-/* Private Functions */
+/** Runs the hooks of the current state and its ancestors.
+ *
+ * @params machine The state machine.
+ */
+void tick_state(const state_machine_t* machine);
 
-/** Finds the next state based on the given parameters.
+/** Gets a state followed by its ancestors, innermost first.
  *
+ * @params machine The state machine.
+ * @params state Where the state is held.
+ * @params depth Filled with the length of the chain.
+ * @returns The chain of states.
+ */
+const state_machine_state_t* const* get_state_chain(
+	const state_machine_t* machine,
+	const state_machine_state_t* const* state,
+	uint8_t* depth
+);
+
+/** Builds the ancestor chain of every state of a configuration.
+ *
+ * @param config The configuration, with the hierarchy to fill.
+ * @returns 1 if every chain fits, 0 if the hierarchy is invalid.
+ */
+uint8_t compile_hierarchy(const state_machine_config_t* config);
+
+/** Checks if a transition held for its whole dwell.
+ *
+ * Restarts the dwell whenever a different transition holds than on the
+ * update before.
+ *
+ * @params machine The state machine.
+ * @params transition The transition that holds.
  * @params params The update parameters.
- * @returns A transition if required. Otherwise the current state and terminator.
+ * @returns 1 if the transition may fire, otherwise 0.
+ */
+uint8_t check_dwell(
+	state_machine_t* machine,
+	const state_machine_transition_t* transition,
+	const state_machine_params_t* params
+);
+
+/** Gets the hysteresis a transition uses.
+ *
+ * @param config The configuration of the transition.
+ * @param transition The transition.
+ * @returns Its own hysteresis, or the configuration's if it has none.
  */
-transition_t find_next_state(state_machine_params_t params);
+uint32_t get_transition_hysteresis(
+	const state_machine_config_t* config,
+	const state_machine_transition_t* transition
+);
 
 /** Updates the hysteresis object.
  *
@@ -58,170 +131,737 @@ transition_t find_next_state(state_machine_params_t params);
  *
  * This function will return immediately if the hysteresis is disabled.
  *
+ * @params machine The state machine.
  * @params next_state The next state transition that was found.
  * @params params The update parameters.
  */
 void update_hysteresis_thresholds(
-	transition_t next_state,
-	state_machine_params_t params
+	state_machine_t* machine,
+	const transition_t* next_state,
+	const state_machine_params_t* params
 );
 
 /** Checks to see if a transition is necessary.
  *
+ * @param machine The state machine.
  * @param transition The transition to verify.
  * @param params The update parameters to compare against.
- * @returns A boolean based on the transition comparator type.
+ * @returns A boolean based on the combined guards of the transition.
  */
 uint8_t check_transition(
-	state_machine_transition_t transition,
-	state_machine_params_t params
+	const state_machine_t* machine,
+	const state_machine_transition_t* transition,
+	const state_machine_params_t* params
 );
 
+/** Checks a single guard of a transition.
+ *
+ * @param guard The guard to verify.
+ * @param params The update parameters to compare against.
+ * @param hysteresis_adjustment How far to move the threshold away.
+ * @returns A boolean based on the guard comparator type.
+ */
+uint8_t check_guard(
+	const state_machine_guard_t* guard,
+	const state_machine_params_t* params,
+	uint32_t hysteresis_adjustment
+);
+
+#if STATE_MACHINE_BAND_LUT
+/** Compiles a state machine configuration into its band lookup table.
+ *
+ * @param config The configuration, with the table to fill.
+ * @returns 1 if the table was built, 0 if the generic path must be used.
+ */
+uint8_t compile_band_lut(const state_machine_config_t* config);
+
+/** Gets the boundary at which a threshold guard changes its result.
+ *
+ * @param guard The threshold guard.
+ * @param hysteresis_adjustment How far the threshold is moved away.
+ * @returns The lowest signal value on the upper side of the boundary.
+ */
+int32_t get_guard_boundary(
+	const state_machine_guard_t* guard,
+	uint32_t hysteresis_adjustment
+);
+
+/** Finds the table entry for the current state and parameters.
+ *
+ * @params machine The state machine, with an active lookup table.
+ * @params params The update parameters.
+ * @returns The band lookup table entry.
+ */
+uint8_t find_band_entry(
+	const state_machine_t* machine,
+	const state_machine_params_t* params
+);
+#endif
+
 /* Public Function Implementations */
 
-state_machine_state_enum_t initialize_state_machine(state_machine_config_t config)
+state_machine_state_enum_t initialize_state_machine(
+	state_machine_t* machine,
+	const state_machine_config_t* config
+)
+{
+	const state_machine_state_t* const* chain;
+	uint8_t depth;
+
+	/* A configuration is compiled once, instances already running on it
+	 * may be reading it from an interrupt */
+	if (config->hierarchy != NULL && !config->hierarchy->is_compiled)
+	{
+		if (!compile_hierarchy(config))
+		{
+			machine->config = NULL;
+			Error_Handler();
+			return INVALID_STATE;
+		}
+		config->hierarchy->is_compiled = 1;
+	}
+
+	machine->config = config;
+	machine->current_state = config->state_machine[INITIAL_STATE];
+	machine->previous_state = config->state_machine[INITIAL_STATE];
+	machine->returning_state = INVALID_STATE;
+	machine->triggered_transition = &STATE_MACHINE_TRANSITION_TERMINATOR;
+	machine->pending_transition = NULL;
+#if STATE_MACHINE_BAND_LUT
+	if (config->band_lut != NULL && !config->band_lut->is_compiled)
+	{
+		config->band_lut->is_active = compile_band_lut(config);
+		config->band_lut->is_compiled = 1;
+	}
+#endif
+	/* Enter the initial state outermost first */
+	chain = get_state_chain(machine, &machine->current_state, &depth);
+	while (depth-- > 0)
+	{
+		if (chain[depth]->on_enter != NULL) chain[depth]->on_enter();
+	}
+	return machine->current_state->state;
+}
+
+state_machine_state_enum_t update_state_machine(
+	state_machine_t* machine,
+	const state_machine_params_t* params
+)
 {
-	state_machine = config.state_machine;
+	if (machine->config == NULL) return INVALID_STATE;
 
-	current_state = state_machine[INITIAL_STATE];
-	previous_state = state_machine[INITIAL_STATE];
-	hysteresis_config.hysteresis = config.hysteresis;
-	hysteresis_config.returning_state = INVALID_STATE;
-	current_state->state_execution();
-	return current_state->state;
+	step_state_machine(machine, params, 1);
+	return machine->current_state->state;
 }
 
-state_machine_state_enum_t update_state_machine(state_machine_params_t params)
+uint16_t update_state_machine_batch(
+	state_machine_t* machine,
+	const state_machine_params_t* params,
+	uint16_t count,
+	state_machine_actions_t actions,
+	state_machine_event_t* events,
+	uint16_t max_events
+)
 {
-	if (state_machine == NULL) return INVALID_STATE;
+	const state_machine_state_t* first_state = machine->current_state;
+	const state_machine_state_t* previous_state;
+	const state_machine_transition_t* taken;
+	transition_t transition;
+	uint16_t written = 0;
+	uint16_t sample;
+
+	if (machine->config == NULL) return 0;
+
+	for (sample = 0; sample < count && written < max_events; sample++)
+	{
+		previous_state = machine->current_state;
+		taken = step_state_machine(machine, &params[sample],
+			actions == STATE_MACHINE_ACTIONS_IMMEDIATE);
+		if (taken == NULL) continue;
+
+		events[written].transition = taken;
+		events[written].sample = sample;
+		events[written].from = previous_state->state;
+		events[written].to = machine->current_state->state;
+		written++;
+	}
+
+	switch(actions)
+	{
+	case STATE_MACHINE_ACTIONS_DEFERRED:
+		/* Catch up on the actions in the order they would have run */
+		for (sample = 0; sample < written; sample++)
+		{
+			previous_state = machine->config->state_machine[events[sample].from];
+			transition.next_state = machine->config->state_machine[events[sample].to];
+			transition.triggering_transition = events[sample].transition;
+			if (transition.next_state != previous_state)
+			{
+				change_state(machine, &previous_state, &transition);
+			}
+			else
+			{
+				transition.triggering_transition->transition_func();
+			}
+		}
+		tick_state(machine);
+		break;
+	case STATE_MACHINE_ACTIONS_COALESCED:
+		/* Only the net change is left and entered */
+		if (machine->current_state != first_state)
+		{
+			transition.next_state = machine->current_state;
+			transition.triggering_transition = &STATE_MACHINE_TRANSITION_TERMINATOR;
+			change_state(machine, &first_state, &transition);
+		}
+		tick_state(machine);
+		break;
+	default:
+		break;
+	}
+	return written;
+}
 
+uint8_t is_state_machine_band_lut_active(const state_machine_t* machine)
+{
+#if STATE_MACHINE_BAND_LUT
+	return machine->config->band_lut != NULL && machine->config->band_lut->is_active;
+#else
+	return 0;
+#endif
+}
+
+/* Private Function Implementations */
+
+const state_machine_transition_t* step_state_machine(
+	state_machine_t* machine,
+	const state_machine_params_t* params,
+	uint8_t run_actions
+)
+{
 	transition_t transition;
 
 	/* Find next state transition and save it */
-	transition = find_next_state(params);
-	update_hysteresis_thresholds(transition, params);
+	find_next_state(machine, params, &transition);
+	if (transition.triggering_transition == &STATE_MACHINE_TRANSITION_TERMINATOR)
+	{
+		machine->pending_transition = NULL;
+	}
+	else if (transition.triggering_transition->dwell != STATE_MACHINE_NO_DWELL &&
+			!check_dwell(machine, transition.triggering_transition, params))
+	{
+		/* Hold off until the transition held for its whole dwell */
+		transition.next_state = machine->current_state;
+		transition.triggering_transition = &STATE_MACHINE_TRANSITION_TERMINATOR;
+	}
+	else
+	{
+		machine->pending_transition = NULL;
+	}
+	update_hysteresis_thresholds(machine, &transition, params);
 	/* Check to see if there was a transition */
-	if (transition.next_state->state != current_state->state)
+	if (transition.next_state != machine->current_state)
 	{
 		/* Save the previous state */
-		previous_state = current_state;
+		machine->previous_state = machine->current_state;
 		/* Activate hysteresis and update parameters */
-		hysteresis_config.returning_state = previous_state->state;
-		update_hysteresis_thresholds(transition, params);
+		machine->returning_state = machine->previous_state->state;
+		update_hysteresis_thresholds(machine, &transition, params);
+		if (run_actions)
+		{
+			change_state(machine, &machine->previous_state, &transition);
+		}
+		else
+		{
+			machine->current_state = transition.next_state;
+		}
+	}
+	else if (transition.triggering_transition != &STATE_MACHINE_TRANSITION_TERMINATOR && run_actions)
+	{
+		/* A transition back into the same state only runs its function */
+		transition.triggering_transition->transition_func();
 	}
 
-	/* Execute the transition's function */
-	transition.triggering_transition.transition_func();
-	/* Execute the next state's function */
-	transition.next_state->state_execution();
-	/* Update the state machine */
-	current_state = transition.next_state;
-	return current_state->state;
+	if (run_actions) tick_state(machine);
+	return (transition.triggering_transition != &STATE_MACHINE_TRANSITION_TERMINATOR) ?
+		transition.triggering_transition : NULL;
 }
 
-/* Private Function Implementations */
-
-transition_t find_next_state(state_machine_params_t params)
+void find_next_state(
+	const state_machine_t* machine,
+	const state_machine_params_t* params,
+	transition_t* next_state
+)
 {
-	transition_t state_machine_update;
-	state_machine_transition_t transition;
-	int i = 0;
+	const state_machine_state_t* const* chain;
+	const state_machine_transition_t* transition;
+	uint8_t depth;
+	uint8_t level = 0;
 
-	/* Check every transition for the current state */
-	do
+	if (machine->config->dispatch != NULL)
 	{
-		transition = state_machine[current_state->state]->transitions[i++];
-		if (check_transition(transition, params))
+		transition = machine->config->dispatch(machine->current_state->state,
+			machine->returning_state, machine->triggered_transition->guards[0].signal, params);
+		if (transition == NULL)
 		{
-			state_machine_update.next_state = state_machine[transition.next_state];
-			state_machine_update.triggering_transition = transition;
-			return state_machine_update;
+			next_state->next_state = machine->current_state;
+			next_state->triggering_transition = &STATE_MACHINE_TRANSITION_TERMINATOR;
+			return;
 		}
-	} while (transition.type != EMPTY);
+		next_state->next_state = machine->config->state_machine[transition->next_state];
+		next_state->triggering_transition = transition;
+		return;
+	}
+
+	chain = get_state_chain(machine, &machine->current_state, &depth);
+	transition = chain[0]->transitions;
+
+#if STATE_MACHINE_BAND_LUT
+	if (is_state_machine_band_lut_active(machine))
+	{
+		uint8_t entry = find_band_entry(machine, params);
+
+		if (entry == BAND_NO_TRANSITION)
+		{
+			next_state->next_state = machine->current_state;
+			next_state->triggering_transition = &STATE_MACHINE_TRANSITION_TERMINATOR;
+			return;
+		}
+		if (entry & BAND_DIRECT)
+		{
+			transition += entry & ~BAND_DIRECT;
+			next_state->next_state = machine->config->state_machine[transition->next_state];
+			next_state->triggering_transition = transition;
+			return;
+		}
+		/* Skip the transitions the table already ruled out */
+		transition += entry;
+	}
+#endif
+
+	/* Check every transition for the current state, then its ancestors */
+	while (1)
+	{
+		for (; transition->guards[0].type != EMPTY; transition++)
+		{
+			if (check_transition(machine, transition, params))
+			{
+				next_state->next_state = machine->config->state_machine[transition->next_state];
+				next_state->triggering_transition = transition;
+				return;
+			}
+		}
+		if (++level >= depth) break;
+		transition = chain[level]->transitions;
+	}
 
 	/* If no transition detected, return the current one. */
-	state_machine_update.next_state = current_state;
-	state_machine_update.triggering_transition = STATE_MACHINE_TRANSITION_TERMINATOR;
-	return state_machine_update;
+	next_state->next_state = machine->current_state;
+	next_state->triggering_transition = &STATE_MACHINE_TRANSITION_TERMINATOR;
+}
+
+void change_state(
+	state_machine_t* machine,
+	const state_machine_state_t* const* previous_state,
+	const transition_t* next_state
+)
+{
+	const state_machine_state_t* const* exit_chain;
+	const state_machine_state_t* const* enter_chain;
+	uint8_t exit_depth, enter_depth;
+	uint8_t exits, enters, level;
+
+	exit_chain = get_state_chain(machine, previous_state, &exit_depth);
+	enter_chain = get_state_chain(machine, &next_state->next_state, &enter_depth);
+
+	/* Find the innermost state both chains share, it stays active */
+	enters = enter_depth;
+	for (exits = 0; exits < exit_depth; exits++)
+	{
+		for (enters = 0; enters < enter_depth; enters++)
+		{
+			if (exit_chain[exits] == enter_chain[enters]) break;
+		}
+		if (enters < enter_depth) break;
+	}
+
+	/* Leave the old states innermost first */
+	for (level = 0; level < exits; level++)
+	{
+		if (exit_chain[level]->on_exit != NULL) exit_chain[level]->on_exit();
+	}
+	next_state->triggering_transition->transition_func();
+	machine->current_state = next_state->next_state;
+	/* Enter the new states outermost first */
+	while (enters-- > 0)
+	{
+		if (enter_chain[enters]->on_enter != NULL) enter_chain[enters]->on_enter();
+	}
+}
+
+void tick_state(const state_machine_t* machine)
+{
+	const state_machine_state_t* const* chain;
+	uint8_t depth;
+	uint8_t level;
+
+	chain = get_state_chain(machine, &machine->current_state, &depth);
+	for (level = 0; level < depth; level++)
+	{
+		if (chain[level]->on_tick != NULL) chain[level]->on_tick();
+	}
+}
+
+const state_machine_state_t* const* get_state_chain(
+	const state_machine_t* machine,
+	const state_machine_state_t* const* state,
+	uint8_t* depth
+)
+{
+	const state_machine_hierarchy_t* hierarchy = machine->config->hierarchy;
+
+	/* Without a hierarchy, every state is a chain of its own */
+	if (hierarchy == NULL)
+	{
+		*depth = 1;
+		return state;
+	}
+
+	*depth = hierarchy->depths[(*state)->state];
+	return hierarchy->chains[(*state)->state];
+}
+
+uint8_t compile_hierarchy(const state_machine_config_t* config)
+{
+	state_machine_hierarchy_t* hierarchy = config->hierarchy;
+	const state_machine_state_t* state;
+	const state_machine_transition_t* transition;
+	state_machine_state_enum_t state_count = 1;
+	state_machine_state_enum_t index;
+	uint8_t depth;
+
+	/* Chain every state the machine can reach, along with its ancestors */
+	for (index = INITIAL_STATE; index < state_count; index++)
+	{
+		if (index >= STATE_MACHINE_MAX_STATES) return 0;
+
+		depth = 0;
+		for (state = config->state_machine[index]; state != NULL; state = state->parent)
+		{
+			/* Too deep also catches a state that is its own ancestor */
+			if (depth >= STATE_MACHINE_MAX_DEPTH || state->state < INITIAL_STATE ||
+					config->state_machine[state->state] != state)
+				return 0;
+			if (state->state >= state_count) state_count = state->state + 1;
+			hierarchy->chains[index][depth++] = state;
+
+			for (transition = state->transitions; transition->guards[0].type != EMPTY; transition++)
+			{
+				if (transition->next_state >= state_count) state_count = transition->next_state + 1;
+			}
+		}
+		hierarchy->depths[index] = depth;
+	}
+
+	return 1;
+}
+
+uint8_t check_dwell(
+	state_machine_t* machine,
+	const state_machine_transition_t* transition,
+	const state_machine_params_t* params
+)
+{
+	uint32_t dwell = transition->dwell & ~STATE_MACHINE_DWELL_US_FLAG;
+
+	if (transition->dwell & STATE_MACHINE_DWELL_US_FLAG)
+	{
+		/* The dwell counts from the first update the transition held on */
+		if (transition != machine->pending_transition)
+		{
+			machine->pending_transition = transition;
+			machine->pending_dwell = params->timestamp_us;
+		}
+		return params->timestamp_us - machine->pending_dwell >= dwell;
+	}
+
+	if (transition != machine->pending_transition)
+	{
+		machine->pending_transition = transition;
+		machine->pending_dwell = 0;
+	}
+	return ++machine->pending_dwell >= dwell;
+}
+
+uint32_t get_transition_hysteresis(
+	const state_machine_config_t* config,
+	const state_machine_transition_t* transition
+)
+{
+	return (transition->hysteresis != STATE_MACHINE_CONFIG_HYSTERESIS) ?
+		transition->hysteresis : config->hysteresis;
 }
 
 void update_hysteresis_thresholds(
-	transition_t next_state,
-	state_machine_params_t params
+	state_machine_t* machine,
+	const transition_t* next_state,
+	const state_machine_params_t* params
 )
 {
+	uint32_t hysteresis;
+	const state_machine_guard_t* guard;
 	int32_t threshold;
 
 	/* Check if hysteresis is active */
-	if (hysteresis_config.returning_state == INVALID_STATE &&
-			hysteresis_config.hysteresis != HYSTERESIS_DISABLED)
+	if (machine->returning_state == INVALID_STATE &&
+			machine->config->hysteresis != HYSTERESIS_DISABLED)
 		return;
 
 	/* Check if there was a transition */
-	if (next_state.triggering_transition.type != EMPTY)
+	if (next_state->triggering_transition->guards[0].type != EMPTY)
 	{
 		/* Save the transition and the corresponding state */
-		hysteresis_config.returning_state = previous_state->state;
-		hysteresis_config.triggered_transition = next_state.triggering_transition;
+		machine->returning_state = machine->previous_state->state;
+		machine->triggered_transition = next_state->triggering_transition;
 	}
 
-	/* Check if outside of threshold */
-	switch(hysteresis_config.triggered_transition.type)
+	/* Check if outside of threshold of the first guard */
+	guard = &machine->triggered_transition->guards[0];
+	hysteresis = get_transition_hysteresis(machine->config, machine->triggered_transition);
+	switch(guard->type)
 	{
 	case LESS_THAN:
 	case LT_EQUALS:
 		/* Subtract hysteresis if approaching from the right */
-		threshold = hysteresis_config
-			.triggered_transition
-			.threshold.distance - hysteresis_config.hysteresis;
-		if (params.distance <= threshold)
+		threshold = guard->threshold - hysteresis;
+		if (params->signals[guard->signal] <= threshold)
 		{
-			hysteresis_config.returning_state = INVALID_STATE;
+			machine->returning_state = INVALID_STATE;
 		}
 		break;
 	case GREATER_THAN:
 	case GT_EQUALS:
 		/* Add hysteresis if approaching from the left */
-		threshold = hysteresis_config
-			.triggered_transition
-			.threshold.distance + hysteresis_config.hysteresis;
-		if (params.distance >= threshold)
+		threshold = guard->threshold + hysteresis;
+		if (params->signals[guard->signal] >= threshold)
 		{
-			hysteresis_config.returning_state = INVALID_STATE;
+			machine->returning_state = INVALID_STATE;
 		}
 		break;
 	default:
 		/* Equals and Not Equals should not have a hysteresis */
-		hysteresis_config.returning_state = INVALID_STATE;
+		machine->returning_state = INVALID_STATE;
 		break;
 	}
 }
 
 uint8_t check_transition(
-	state_machine_transition_t transition,
-	state_machine_params_t params
+	const state_machine_t* machine,
+	const state_machine_transition_t* transition,
+	const state_machine_params_t* params
 )
 {
 	/* Check if the hysteresis is active and apply it */
-	uint8_t is_hysteresis_active = (hysteresis_config.returning_state == transition.next_state);
-	uint32_t hysteresis_adjustment = (is_hysteresis_active ? hysteresis_config.hysteresis : HYSTERESIS_DISABLED);
-	switch(transition.type)
+	uint8_t is_hysteresis_active = (machine->returning_state == transition->next_state);
+	uint32_t hysteresis_adjustment = (is_hysteresis_active ?
+		get_transition_hysteresis(machine->config, transition) : HYSTERESIS_DISABLED);
+	/* Only guards on the signal the hysteresis tracks are adjusted */
+	state_machine_signal_t hysteresis_signal = machine->triggered_transition->guards[0].signal;
+	uint8_t result = check_guard(&transition->guards[0], params,
+		(transition->guards[0].signal == hysteresis_signal) ? hysteresis_adjustment : HYSTERESIS_DISABLED);
+
+	switch(transition->combination)
+	{
+	case GUARD_AND:
+		return result && check_guard(&transition->guards[1], params,
+			(transition->guards[1].signal == hysteresis_signal) ? hysteresis_adjustment : HYSTERESIS_DISABLED);
+	case GUARD_OR:
+		return result || check_guard(&transition->guards[1], params,
+			(transition->guards[1].signal == hysteresis_signal) ? hysteresis_adjustment : HYSTERESIS_DISABLED);
+	default:
+		return result;
+	}
+}
+
+uint8_t check_guard(
+	const state_machine_guard_t* guard,
+	const state_machine_params_t* params,
+	uint32_t hysteresis_adjustment
+)
+{
+	int32_t signal = params->signals[guard->signal];
+
+	switch(guard->type)
 	{
 	case EQUAL:
-		return params.distance == transition.threshold.distance;
+		return signal == guard->threshold;
 	case LESS_THAN:
-		return params.distance < transition.threshold.distance - hysteresis_adjustment;
+		return signal < guard->threshold - (int32_t)hysteresis_adjustment;
 	case GREATER_THAN:
-		return params.distance > transition.threshold.distance + hysteresis_adjustment;
+		return signal > guard->threshold + (int32_t)hysteresis_adjustment;
 	case LT_EQUALS:
-		return params.distance <= transition.threshold.distance - hysteresis_adjustment;
+		return signal <= guard->threshold - (int32_t)hysteresis_adjustment;
 	case GT_EQUALS:
-		return params.distance >= transition.threshold.distance + hysteresis_adjustment;
+		return signal >= guard->threshold + (int32_t)hysteresis_adjustment;
 	case NOT_EQUALS:
-		return params.distance != transition.threshold.distance;
+		return signal != guard->threshold;
 	default:
 		return 0;
 	}
 }
 
+#if STATE_MACHINE_BAND_LUT
+uint8_t compile_band_lut(const state_machine_config_t* config)
+{
+	state_machine_band_lut_t* band_lut = config->band_lut;
+	const state_machine_transition_t* transition;
+	state_machine_params_t probe = {0};
+	state_machine_state_enum_t state_count = 1;
+	state_machine_state_enum_t state;
+	state_machine_state_enum_t returning_state;
+	uint32_t band, adjustment, hysteresis, distance;
+	uint8_t is_first = 1;
+	int32_t boundary, top = 0;
+	int i;
+
+	band_lut->width = 0;
+
+	/* Inherited transitions do not fit the table */
+	if (config->hierarchy != NULL) return 0;
+
+	/* Collect every boundary of every state the machine can reach */
+	for (state = INITIAL_STATE; state < state_count; state++)
+	{
+		if (config->state_machine[state]->state != state) return 0;
+
+		for (i = 0; config->state_machine[state]->transitions[i].guards[0].type != EMPTY; i++)
+		{
+			transition = &config->state_machine[state]->transitions[i];
+			/* i | BAND_DIRECT must never read as BAND_NO_TRANSITION */
+			if (i >= BAND_DIRECT - 1 || transition->next_state < INITIAL_STATE ||
+					transition->next_state >= STATE_MACHINE_LUT_MAX_STATES)
+				return 0;
+			if (transition->next_state >= state_count)
+				state_count = transition->next_state + 1;
+
+			/* Only thresholds on a single signal can be cut into bands */
+			switch(transition->guards[0].type)
+			{
+			case LESS_THAN:
+			case GREATER_THAN:
+			case LT_EQUALS:
+			case GT_EQUALS:
+				break;
+			default:
+				return 0;
+			}
+			if (is_first)
+			{
+				band_lut->signal = transition->guards[0].signal;
+				band_lut->base = get_guard_boundary(&transition->guards[0], HYSTERESIS_DISABLED);
+				top = band_lut->base;
+				is_first = 0;
+			}
+			if (transition->guards[0].signal != band_lut->signal) return 0;
+
+			/* The band width is the greatest common divisor of the boundary spacing */
+			hysteresis = get_transition_hysteresis(config, transition);
+			for (adjustment = 0; adjustment < 2; adjustment++)
+			{
+				boundary = get_guard_boundary(&transition->guards[0],
+					adjustment ? hysteresis : HYSTERESIS_DISABLED);
+				distance = (boundary > top) ? (uint32_t)(boundary - top) : (uint32_t)(top - boundary);
+				while (distance != 0)
+				{
+					uint32_t remainder = band_lut->width % distance;
+					band_lut->width = distance;
+					distance = remainder;
+				}
+				if (boundary < band_lut->base) band_lut->base = boundary;
+				if (boundary > top) top = boundary;
+			}
+		}
+	}
+
+	/* Nothing but the terminator, no transition can ever be taken */
+	if (is_first) return 0;
+
+	if (band_lut->width == 0) band_lut->width = 1;
+	band_lut->band_count = (uint32_t)(top - band_lut->base) / band_lut->width + 2;
+	if (band_lut->band_count > STATE_MACHINE_LUT_MAX_BANDS) return 0;
+
+	/* Work out the first transition that can hold for every combination */
+	for (state = INITIAL_STATE; state < state_count; state++)
+	{
+		for (returning_state = INVALID_STATE; returning_state < state_count; returning_state++)
+		{
+			for (band = 0; band < band_lut->band_count; band++)
+			{
+				uint8_t* entry = &band_lut->entries[state][returning_state + 1][band];
+
+				probe.signals[band_lut->signal] = (band == 0) ? band_lut->base - 1 :
+					band_lut->base + (int32_t)((band - 1) * band_lut->width);
+				*entry = BAND_NO_TRANSITION;
+				for (i = 0; config->state_machine[state]->transitions[i].guards[0].type != EMPTY; i++)
+				{
+					transition = &config->state_machine[state]->transitions[i];
+					adjustment = (returning_state == transition->next_state) ?
+						get_transition_hysteresis(config, transition) : HYSTERESIS_DISABLED;
+
+					if (check_guard(&transition->guards[0], &probe, adjustment))
+					{
+						/* Only an AND still depends on its second guard */
+						*entry = (transition->combination == GUARD_AND) ? i : (i | BAND_DIRECT);
+						break;
+					}
+					if (transition->combination == GUARD_OR)
+					{
+						*entry = i;
+						break;
+					}
+				}
+			}
+		}
+	}
+
+	return 1;
+}
+
+int32_t get_guard_boundary(
+	const state_machine_guard_t* guard,
+	uint32_t hysteresis_adjustment
+)
+{
+	switch(guard->type)
+	{
+	case LESS_THAN:
+		return guard->threshold - (int32_t)hysteresis_adjustment;
+	case LT_EQUALS:
+		return guard->threshold - (int32_t)hysteresis_adjustment + 1;
+	case GREATER_THAN:
+		return guard->threshold + (int32_t)hysteresis_adjustment + 1;
+	default:
+		return guard->threshold + (int32_t)hysteresis_adjustment;
+	}
+}
+
+uint8_t find_band_entry(
+	const state_machine_t* machine,
+	const state_machine_params_t* params
+)
+{
+	const state_machine_band_lut_t* band_lut = machine->config->band_lut;
+	int32_t signal = params->signals[band_lut->signal];
+	uint32_t band = 0;
+
+	if (signal >= band_lut->base)
+	{
+		band = ((uint32_t)signal - (uint32_t)band_lut->base) / band_lut->width + 1;
+		if (band >= band_lut->band_count) band = band_lut->band_count - 1;
+	}
+
+	return band_lut->entries[machine->current_state->state][machine->returning_state + 1][band];
+}
+#endif
+
 void STATE_MACHINE_NO_FUNC() {}
@@ -23,6 +23,11 @@
 #include "stm32l4xx_it.h"
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
+#include "timestamp.h"
+#include "alert_pipeline.h"
+#include "scheduler.h"
+#include "activity.h"
+#include "ultrasound.h"
 /* USER CODE END Includes */
 
 /* Private typedef -----------------------------------------------------------*/
@@ -60,6 +65,10 @@ extern DMA_HandleTypeDef hdma_tim2_ch1;
 extern TIM_HandleTypeDef htim2;
 extern DMA_HandleTypeDef hdma_usart2_tx;
 /* USER CODE BEGIN EV */
+extern DMA_HandleTypeDef hdma_tim2_ch3;
+extern TIM_HandleTypeDef htim5;
+extern TIM_HandleTypeDef htim6;
+extern UART_HandleTypeDef huart2;
 
 /* USER CODE END EV */
 
@@ -171,10 +180,14 @@ void DebugMon_Handler(void)
 void PendSV_Handler(void)
 {
   /* USER CODE BEGIN PendSV_IRQn 0 */
-
+  enter_activity();
+#if ALERT_PIPELINE_PENDSV
+  /* Pended by every published echo, see ultrasound_sample_callback() */
+  run_alert_pipeline();
+#endif
   /* USER CODE END PendSV_IRQn 0 */
   /* USER CODE BEGIN PendSV_IRQn 1 */
-
+  exit_activity();
   /* USER CODE END PendSV_IRQn 1 */
 }
 
@@ -184,11 +197,13 @@ void PendSV_Handler(void)
 void SysTick_Handler(void)
 {
   /* USER CODE BEGIN SysTick_IRQn 0 */
-
+  enter_activity();
   /* USER CODE END SysTick_IRQn 0 */
   HAL_IncTick();
   /* USER CODE BEGIN SysTick_IRQn 1 */
-
+  /* Keeps the timestamp clock from missing a cycle counter wrap */
+  get_timestamp_us();
+  exit_activity();
   /* USER CODE END SysTick_IRQn 1 */
 }
 
@@ -205,11 +220,11 @@ void SysTick_Handler(void)
 void DMA1_Channel5_IRQHandler(void)
 {
   /* USER CODE BEGIN DMA1_Channel5_IRQn 0 */
-
+  enter_activity();
   /* USER CODE END DMA1_Channel5_IRQn 0 */
   HAL_DMA_IRQHandler(&hdma_tim2_ch1);
   /* USER CODE BEGIN DMA1_Channel5_IRQn 1 */
-
+  exit_activity();
   /* USER CODE END DMA1_Channel5_IRQn 1 */
 }
 
@@ -219,11 +234,11 @@ void DMA1_Channel5_IRQHandler(void)
 void DMA1_Channel7_IRQHandler(void)
 {
   /* USER CODE BEGIN DMA1_Channel7_IRQn 0 */
-
+  enter_activity();
   /* USER CODE END DMA1_Channel7_IRQn 0 */
   HAL_DMA_IRQHandler(&hdma_usart2_tx);
   /* USER CODE BEGIN DMA1_Channel7_IRQn 1 */
-
+  exit_activity();
   /* USER CODE END DMA1_Channel7_IRQn 1 */
 }
 
@@ -233,15 +248,65 @@ void DMA1_Channel7_IRQHandler(void)
 void TIM2_IRQHandler(void)
 {
   /* USER CODE BEGIN TIM2_IRQn 0 */
-
+  enter_activity();
   /* USER CODE END TIM2_IRQn 0 */
   HAL_TIM_IRQHandler(&htim2);
   /* USER CODE BEGIN TIM2_IRQn 1 */
-
+  /* Also pended by readers, see process_ultrasound_requests() */
+  process_ultrasound_requests();
+  exit_activity();
   /* USER CODE END TIM2_IRQn 1 */
 }
 
 /* USER CODE BEGIN 1 */
+/**
+  * @brief This function handles DMA1 channel1 global interrupt.
+  * Only enabled with three or more ultrasound sensors.
+  */
+void DMA1_Channel1_IRQHandler(void)
+{
+  enter_activity();
+  HAL_DMA_IRQHandler(&hdma_tim2_ch3);
+  exit_activity();
+}
+
+/**
+  * @brief This function handles TIM5 global interrupt.
+  * Only enabled with more than one ultrasound sensor.
+  */
+void TIM5_IRQHandler(void)
+{
+  enter_activity();
+  HAL_TIM_IRQHandler(&htim5);
+  exit_activity();
+}
+
+/**
+  * @brief This function handles USART2 global interrupt.
+  * Ends each telemetry transfer and chains the next one.
+  */
+void USART2_IRQHandler(void)
+{
+  enter_activity();
+  HAL_UART_IRQHandler(&huart2);
+  exit_activity();
+}
+
+/**
+  * @brief This function handles TIM6 global interrupt.
+  * Runs the scheduler tasks in INTERRUPT_DRIVEN_MODE, otherwise only wakes
+  * the scheduler, which clears it before interrupts run again.
+  */
+void TIM6_DAC_IRQHandler(void)
+{
+  enter_activity();
+#if INTERRUPT_DRIVEN_MODE
+  dispatch_scheduler();
+#else
+  __HAL_TIM_CLEAR_FLAG(&htim6, TIM_FLAG_UPDATE);
+#endif
+  exit_activity();
+}
 
 /* USER CODE END 1 */
 /************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
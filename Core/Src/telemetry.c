@@ -0,0 +1,105 @@
+#include "telemetry.h"
+#include "spsc_ring.h"
+#include "usart.h"
+
+#if !SPSC_RING_IS_POWER_OF_TWO(TELEMETRY_BUFFER_SIZE)
+#error "TELEMETRY_BUFFER_SIZE must be a power of two"
+#endif
+
+/* Private Variables */
+
+/* Queued bytes, written at the head and sent from the tail. Both run
+ * freely and wrap through the buffer with a mask. */
+uint8_t telemetry_buffer[TELEMETRY_BUFFER_SIZE];
+volatile uint32_t telemetry_head = 0;
+volatile uint32_t telemetry_tail = 0;
+
+/* Bytes of the DMA transfer in flight, 0 while the UART is idle */
+volatile uint32_t telemetry_sending = 0;
+volatile uint32_t telemetry_drops = 0;
+
+/* Private Functions */
+
+/** Sends the bytes queued from the tail on, if the UART is idle.
+ *
+ * A transfer stops at the end of the buffer, the next one carries on from
+ * its start. Must be called with interrupts masked.
+ */
+void start_telemetry_transfer();
+
+/* Public Function Implementations */
+
+void initialize_telemetry()
+{
+	telemetry_head = 0;
+	telemetry_tail = 0;
+	telemetry_sending = 0;
+	telemetry_drops = 0;
+
+	/* The DMA only ends the transfer, the UART reports it complete */
+	HAL_NVIC_SetPriority(USART2_IRQn, TELEMETRY_IRQ_PRIORITY, 0);
+	HAL_NVIC_EnableIRQ(USART2_IRQn);
+}
+
+uint8_t write_telemetry(const char* data, uint32_t size)
+{
+	uint32_t primask = __get_PRIMASK();
+	uint32_t head = telemetry_head;
+	uint32_t index;
+
+	/* Unsigned subtraction is correct across a wrap of either index */
+	if (size > TELEMETRY_BUFFER_SIZE - (head - telemetry_tail))
+	{
+		telemetry_drops++;
+		return 0;
+	}
+
+	for (index = 0; index < size; index++)
+	{
+		telemetry_buffer[(head + index) & (TELEMETRY_BUFFER_SIZE - 1)] = (uint8_t)data[index];
+	}
+	/* The bytes must be complete before the head hands them over */
+	__DMB();
+	telemetry_head = head + size;
+
+	__disable_irq();
+	start_telemetry_transfer();
+	__set_PRIMASK(primask);
+	return 1;
+}
+
+uint32_t get_telemetry_drops()
+{
+	return telemetry_drops;
+}
+
+/* Chains the next transfer when the last one left the UART */
+void HAL_UART_TxCpltCallback(UART_HandleTypeDef* huart)
+{
+	uint32_t primask = __get_PRIMASK();
+
+	if (huart != &huart2) return;
+
+	__disable_irq();
+	telemetry_tail += telemetry_sending;
+	telemetry_sending = 0;
+	start_telemetry_transfer();
+	__set_PRIMASK(primask);
+}
+
+/* Private Function Implementations */
+
+void start_telemetry_transfer()
+{
+	uint32_t tail = telemetry_tail;
+	uint32_t offset = tail & (TELEMETRY_BUFFER_SIZE - 1);
+	uint32_t size = telemetry_head - tail;
+
+	if (telemetry_sending != 0 || size == 0) return;
+
+	if (size > TELEMETRY_BUFFER_SIZE - offset) size = TELEMETRY_BUFFER_SIZE - offset;
+	if (HAL_UART_Transmit_DMA(&huart2, &telemetry_buffer[offset], (uint16_t)size) == HAL_OK)
+	{
+		telemetry_sending = size;
+	}
+}
@@ -0,0 +1,52 @@
+#include "timestamp.h"
+
+/* Private Variables */
+
+/* Cycle counter value of the last read */
+uint32_t last_cycles = 0;
+/* Cycles since the last read that do not make up a whole microsecond yet */
+uint32_t remainder_cycles = 0;
+/* Time in us up to the last read */
+uint64_t timestamp_us = 0;
+/* Cycles per microsecond of the core clock */
+uint32_t cycles_per_us = 1;
+
+/* Public Function Implementations */
+
+void initialize_timestamp()
+{
+	cycles_per_us = SystemCoreClock / 1000000;
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CYCCNT = 0;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+	last_cycles = 0;
+	remainder_cycles = 0;
+	timestamp_us = 0;
+}
+
+uint64_t get_timestamp_us()
+{
+	uint32_t primask = __get_PRIMASK();
+	uint32_t cycles;
+	uint64_t now_us;
+
+	__disable_irq();
+	/* Unsigned subtraction is correct across a single wrap */
+	cycles = DWT->CYCCNT;
+	remainder_cycles += cycles - last_cycles;
+	last_cycles = cycles;
+	timestamp_us += remainder_cycles / cycles_per_us;
+	remainder_cycles %= cycles_per_us;
+	now_us = timestamp_us;
+	__set_PRIMASK(primask);
+	return now_us;
+}
+
+void advance_timestamp(uint32_t elapsed_us)
+{
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq();
+	timestamp_us += elapsed_us;
+	__set_PRIMASK(primask);
+}
@@ -1,38 +1,934 @@
 #include "ultrasound.h"
 #include "tim.h"
+#include "spsc_ring.h"
 
+#if (ULTRASOUND_EDGE_RING_SIZE < 4) || (ULTRASOUND_EDGE_RING_SIZE % 2 != 0)
+#error "ULTRASOUND_EDGE_RING_SIZE must be even and at least 4"
+#endif
+
+#if (ULTRASOUND_SENSOR_COUNT < 1) || (ULTRASOUND_SENSOR_COUNT > ULTRASOUND_MAX_SENSORS)
+#error "ULTRASOUND_SENSOR_COUNT must be between 1 and ULTRASOUND_MAX_SENSORS"
+#endif
+
+#if ULTRASOUND_SYNC_CAPTURE && ULTRASOUND_SENSOR_COUNT > 1
+#error "ULTRASOUND_SYNC_CAPTURE only supports a single sensor"
+#endif
+
+#if !SPSC_RING_IS_POWER_OF_TWO(ULTRASOUND_ECHO_QUEUE_SIZE) || \
+		!SPSC_RING_IS_POWER_OF_TWO(ULTRASOUND_SAMPLE_QUEUE_SIZE)
+#error "ULTRASOUND_ECHO_QUEUE_SIZE and ULTRASOUND_SAMPLE_QUEUE_SIZE must be powers of two"
+#endif
+
+#if ULTRASOUND_BURST_MODE && !ULTRASOUND_SYNC_CAPTURE
+#error "ULTRASOUND_BURST_MODE requires ULTRASOUND_SYNC_CAPTURE"
+#endif
+
+/* Private Defines */
+
+/* Echo line level after a rising edge */
+#define EDGE_RISING GPIO_PIN_SET
+
+/* The fourth trigger needs TIM5 CH1 on PA0, so the first echo moves to PA15 */
+#if ULTRASOUND_SENSOR_COUNT > 3
+#define SENSOR_0_ECHO_GPIO_Port GPIOA
+#define SENSOR_0_ECHO_Pin GPIO_PIN_15
+#else
+#define SENSOR_0_ECHO_GPIO_Port US_ECHO_GPIO_Port
+#define SENSOR_0_ECHO_Pin US_ECHO_Pin
+#endif
+
+/* Private Typedefs */
+
+/** Ultrasound sensor wiring
+ *
+ * capture_channel: TIM2 channel capturing the echo line.
+ * trigger_channel: TIM5 channel driving the trigger line.
+ * dma: DMA filling the edge ring, or NULL if the capture interrupt fills it
+ * because the DMA1 request map has no free channel left for it.
+ */
+typedef struct
+{
+	uint32_t capture_channel;
+	uint32_t trigger_channel;
+	GPIO_TypeDef* echo_port;
+	uint16_t echo_pin;
+	GPIO_TypeDef* trigger_port;
+	uint16_t trigger_pin;
+	DMA_HandleTypeDef* dma;
+} ultrasound_sensor_config_t;
+
+/** Ultrasound sensor capture state
+ *
+ * Everything process_edges() and the readers keep for a single sensor.
+ */
+typedef struct
+{
+	/* Circular destination for every capture of this sensor */
+	uint32_t edge_ring[ULTRASOUND_EDGE_RING_SIZE];
+	/* Next entry the capture interrupt writes when there is no DMA */
+	uint32_t edge_write_index;
+	/* Next edge ring entry that has not been processed */
+	uint32_t edge_read_index;
+	/* Rising edge that is still waiting for its falling edge */
+	uint32_t pending_rising_edge;
+	uint8_t has_pending_rising_edge;
+	/* Times the polled DMA lapped the read index */
+	uint32_t edge_overruns;
+	uint32_t last_read_us;
+	/* Completed echoes that have not yet been read out, queued only while
+	 * a reader is attached */
+	uint32_t echo_queue_us[ULTRASOUND_ECHO_QUEUE_SIZE];
+	spsc_ring_t echo_queue;
+	volatile uint8_t is_echo_reader_attached;
+	/** Latest published sample
+	 *
+	 * Guarded by a sequence lock: sample_lock is odd while the sample is
+	 * being written, so readers retry until they see the same even value
+	 * on both sides of their copy.
+	 */
+	volatile uint32_t sample_lock;
+	ultrasound_sample_t latest_sample;
+} ultrasound_sensor_t;
+
+/* Private Variables */
+extern DMA_HandleTypeDef hdma_tim2_ch1;
+DMA_HandleTypeDef hdma_tim2_ch3;
+
+/* Sensor n echoes on TIM2 CH(n + 1), CH2 and CH4 share a busy DMA channel */
+const ultrasound_sensor_config_t sensor_configs[ULTRASOUND_MAX_SENSORS] =
+{
+	{TIM_CHANNEL_1, TIM_CHANNEL_2, SENSOR_0_ECHO_GPIO_Port, SENSOR_0_ECHO_Pin,
+		US_TRIG_GPIO_Port, US_TRIG_Pin, &hdma_tim2_ch1},
+	{TIM_CHANNEL_2, TIM_CHANNEL_3, GPIOB, GPIO_PIN_3, GPIOA, GPIO_PIN_2, NULL},
+	{TIM_CHANNEL_3, TIM_CHANNEL_4, GPIOB, GPIO_PIN_10, GPIOA, GPIO_PIN_3, &hdma_tim2_ch3},
+	{TIM_CHANNEL_4, TIM_CHANNEL_1, GPIOB, GPIO_PIN_11, GPIOA, GPIO_PIN_0, NULL},
+};
+
+ultrasound_sensor_t sensors[ULTRASOUND_SENSOR_COUNT] = {0};
+
+/* Last echo completed by any sensor */
 uint32_t last_read_us;
-uint32_t timer_triggers_us[2];
+
+/* Every published sample of any sensor until read_ultrasound_samples() */
+ultrasound_sample_t sample_queue_buffer[ULTRASOUND_SAMPLE_QUEUE_SIZE];
+spsc_ring_t sample_queue = {0};
+
+/* Sensor whose trigger pulse is preloaded for the next TIM5 period */
+uint8_t next_trigger_sensor = 0;
+
+/* Ping period requested through set_ultrasound_ping_rate() */
+uint32_t requested_ping_period_us = 1000000 / ULTRASOUND_DEFAULT_PING_RATE_HZ;
+
+/* Millimeters per echo us, in ULTRASOUND_SCALE_BITS fixed point */
+uint32_t mm_per_us_scale =
+	((ULTRASOUND_SPEED_OF_SOUND_M_S << ULTRASOUND_SCALE_BITS) + 1000) / 2000;
+
+/* Time from the end of an echo to the next trigger in burst mode */
+uint32_t burst_guard_us = ULTRASOUND_BURST_GUARD_US;
+
+/* Set by readers, the capture interrupt drains the DMA edges for them */
+volatile uint8_t is_capture_update_requested = 0;
+
+/* Private Functions */
+
+/** Processes every edge of a sensor written since the last call.
+ *
+ * The captures only store timestamps, so the polarity of each edge is
+ * recovered from the echo line: the newest edge always matches the current
+ * pin level and older edges alternate from there. A missed edge therefore
+ * costs at most a single echo instead of swapping rising and falling edges
+ * for good.
+ *
+ * Each echo is stamped with the time of its falling edge, worked back from
+ * TIM2 and the clock at the time of the call. This is exact while the
+ * edges of one call are less than a TIM2 period apart and the newest one
+ * is less than a TIM2 period old.
+ *
+ * Must not be interrupted by another call to itself.
+ *
+ * @params sensor The sensor to process.
+ */
+void process_edges(uint8_t sensor);
+
+/** Checks if the polled DMA lapped the edge read index.
+ *
+ * The half and full transfer flags are set whenever the DMA passes the
+ * middle or the end of the ring, even with their interrupts off. A flag the
+ * way from the read to the write index does not pass means the DMA went all
+ * the way around at least once.
+ * A lap that ends past both flags looks like new edges, which takes more
+ * than the ULTRASOUND_EDGE_RING_SIZE / 2 echoes allowed between polls.
+ *
+ * @params read_index The edge read index.
+ * @params write_index The DMA write index.
+ * @params has_passed_half The half transfer flag.
+ * @params has_passed_end The transfer complete flag.
+ * @returns 1 if edges were overwritten before they were processed.
+ */
+uint8_t is_edge_ring_overrun(
+	uint32_t read_index,
+	uint32_t write_index,
+	uint8_t has_passed_half,
+	uint8_t has_passed_end
+);
+
+/** Processes the edges of every sensor captured by DMA.
+ *
+ * Interrupt captured sensors are processed on each edge already.
+ */
+void process_dma_edges();
+
+/** Has the capture interrupt drain the DMA edges and reload the ping period.
+ *
+ * Pends TIM2, which preempts anything below the acquisition priority before
+ * this returns, so readers find the edges of a batch the DMA has not
+ * finished yet without ever processing edges themselves. Called at the
+ * acquisition priority or with interrupts masked, the update runs once the
+ * caller is done.
+ */
+void request_capture_update();
+
+/** Stores a completed echo and updates the latest reading.
+ *
+ * @params sensor The sensor the echo belongs to.
+ * @params echo_us The echo width in microseconds.
+ * @params timestamp_us The time the echo ended.
+ */
+void push_echo(uint8_t sensor, uint32_t echo_us, uint64_t timestamp_us);
+
+/** Publishes a completed echo as the latest sample of its sensor.
+ *
+ * Only called from process_edges(), so there is a single writer.
+ *
+ * @params sensor The sensor the echo belongs to.
+ * @params echo_us The echo width in microseconds.
+ * @params timestamp_us The time the echo ended.
+ */
+void publish_sample(uint8_t sensor, uint32_t echo_us, uint64_t timestamp_us);
+
+/** Sets up the echo capture and trigger channels of every extra sensor.
+ *
+ * Sensor 0 is set up by MX_TIM2_Init() and MX_TIM5_Init(). The others get
+ * their pins, input capture and PWM channel here, and a DMA channel where
+ * the DMA1 request map has one free.
+ */
+void configure_sensor_array();
+
+/** Moves the trigger pulse on to the next sensor in turn.
+ *
+ * The TIM5 compares are preloaded, so the pulse moves on at the next update
+ * event and a ping in progress is never cut short.
+ */
+void hand_over_trigger();
+
+/** Starts the DMA capture of a sensor without any DMA interrupts.
+ *
+ * HAL_TIM_IC_Start_DMA() always enables the half and full transfer
+ * interrupts, so the DMA and the capture request are started by hand.
+ *
+ * @params sensor The sensor to start, must have a DMA.
+ */
+void start_polled_capture(uint8_t sensor);
+
+/** Puts TIM2 in slave reset mode on every echo line edge.
+ *
+ * TIM5 TRGO has no internal trigger route to TIM2 on the STM32L476, so the
+ * echo line itself (TI1FP1) is used as the reset source instead. The rising
+ * edge starts the count and the falling edge captures the time of flight.
+ */
+void configure_sync_capture();
+
+/** Loads the requested ping period, bounded by the re-trigger interval.
+ *
+ * Sensors take turns, so TIM5 runs at the ping rate times the sensor count.
+ * Only touches TIM5 when the resulting period differs from the current one.
+ */
+void update_ping_period();
+
+/** Chains TIM5 to TIM2 so every echo edge re-arms the trigger.
+ *
+ * TIM2 TRGO fires on each update: the slave reset of every echo edge and
+ * the overflow of a silent period. TIM5 takes it on ITR0 in combined reset
+ * and trigger mode and emits a single pulse after the guard time, so only
+ * the last edge of an echo schedules the next ping.
+ */
+void configure_burst_trigger();
+
+/* Public Function Implementations */
 
 void enable_ultrasound()
 {
-	HAL_TIM_IC_Start_DMA(&htim2, TIM_CHANNEL_1, timer_triggers_us, 2);
-	HAL_TIM_PWM_Start(&htim5, TIM_CHANNEL_2);
+	uint8_t sensor;
+
+	for (sensor = 0; sensor < ULTRASOUND_SENSOR_COUNT; sensor++)
+	{
+		sensors[sensor].edge_write_index = 0;
+		sensors[sensor].edge_read_index = 0;
+		sensors[sensor].has_pending_rising_edge = 0;
+		sensors[sensor].edge_overruns = 0;
+		initialize_spsc_ring(&sensors[sensor].echo_queue, sensors[sensor].echo_queue_us,
+			sizeof(uint32_t), ULTRASOUND_ECHO_QUEUE_SIZE);
+	}
+	initialize_spsc_ring(&sample_queue, sample_queue_buffer,
+		sizeof(ultrasound_sample_t), ULTRASOUND_SAMPLE_QUEUE_SIZE);
+#if ULTRASOUND_SYNC_CAPTURE
+	configure_sync_capture();
+#endif
+#if ULTRASOUND_SENSOR_COUNT > 1
+	configure_sensor_array();
+#endif
+	/* Period changes wait for the update event to stay glitch-free */
+	SET_BIT(htim5.Instance->CR1, TIM_CR1_ARPE);
+	htim5.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_ENABLE;
+#if ULTRASOUND_BURST_MODE
+	configure_burst_trigger();
+#else
+	update_ping_period();
+#endif
+	for (sensor = 0; sensor < ULTRASOUND_SENSOR_COUNT; sensor++)
+	{
+		if (sensor_configs[sensor].dma != NULL)
+		{
+#if ULTRASOUND_POLLED_CAPTURE
+			start_polled_capture(sensor);
+#else
+			HAL_TIM_IC_Start_DMA(&htim2, sensor_configs[sensor].capture_channel,
+				sensors[sensor].edge_ring, ULTRASOUND_EDGE_RING_SIZE);
+#endif
+		}
+		else
+		{
+			HAL_TIM_IC_Start_IT(&htim2, sensor_configs[sensor].capture_channel);
+		}
+		HAL_TIM_PWM_Start(&htim5, sensor_configs[sensor].trigger_channel);
+	}
+#if ULTRASOUND_SENSOR_COUNT > 1
+	/* Sensor 0 pings first, then every TIM5 update hands the trigger on */
+	next_trigger_sensor = 0;
+	__HAL_TIM_SET_COMPARE(&htim5, sensor_configs[0].trigger_channel,
+		ULTRASOUND_TRIGGER_PULSE_US);
+	htim5.Instance->EGR = TIM_EGR_UG;
+	hand_over_trigger();
+	__HAL_TIM_CLEAR_FLAG(&htim5, TIM_FLAG_UPDATE);
+	__HAL_TIM_ENABLE_IT(&htim5, TIM_IT_UPDATE);
+#endif
+#if ULTRASOUND_BURST_MODE
+	/* A slave in trigger mode is not started by HAL, fire the first ping */
+	__HAL_TIM_ENABLE(&htim5);
+#endif
 }
 
 void disable_ultrasound()
 {
-	HAL_TIM_IC_Stop_DMA(&htim2, TIM_CHANNEL_1);
-	HAL_TIM_PWM_Stop(&htim5, TIM_CHANNEL_2);
+	uint8_t sensor;
+
+	__HAL_TIM_DISABLE_IT(&htim5, TIM_IT_UPDATE);
+	for (sensor = 0; sensor < ULTRASOUND_SENSOR_COUNT; sensor++)
+	{
+		if (sensor_configs[sensor].dma != NULL)
+		{
+			HAL_TIM_IC_Stop_DMA(&htim2, sensor_configs[sensor].capture_channel);
+		}
+		else
+		{
+			HAL_TIM_IC_Stop_IT(&htim2, sensor_configs[sensor].capture_channel);
+		}
+		HAL_TIM_PWM_Stop(&htim5, sensor_configs[sensor].trigger_channel);
+	}
 }
 
-float get_read_cm()
+uint32_t get_read_cm()
 {
-	return get_read_us() / 58.0f;
+	return get_read_mm() / 10;
+}
+
+uint32_t get_read_mm()
+{
+	return ultrasound_echo_to_mm(get_read_us());
 }
 
 uint32_t get_read_us()
 {
+	/* Pick up echoes from a batch the DMA has not finished yet */
+	request_capture_update();
 	return last_read_us;
 }
 
+uint32_t ultrasound_echo_to_mm(uint32_t echo_us)
+{
+	/* The echo covers the distance twice: mm = echo_us * c[m/s] / 2000 */
+	return (echo_us * mm_per_us_scale) >> ULTRASOUND_SCALE_BITS;
+}
+
+void set_ultrasound_speed_of_sound(uint32_t speed_m_s)
+{
+	/* Faster would overflow the 32 bit product in ultrasound_echo_to_mm() */
+	if (speed_m_s > ULTRASOUND_MAX_SPEED_OF_SOUND_M_S) speed_m_s = ULTRASOUND_MAX_SPEED_OF_SOUND_M_S;
+	if (speed_m_s < ULTRASOUND_MIN_SPEED_OF_SOUND_M_S) speed_m_s = ULTRASOUND_MIN_SPEED_OF_SOUND_M_S;
+
+	/* A single word store, the ISR sees either the old or the new scale */
+	mm_per_us_scale = ((speed_m_s << ULTRASOUND_SCALE_BITS) + 1000) / 2000;
+}
+
+void attach_ultrasound_echo_reader(uint8_t sensor)
+{
+	uint32_t echo_us;
+
+	if (sensor >= ULTRASOUND_SENSOR_COUNT) return;
+
+	/* Echoes left from an earlier reader are dropped by the consumer side,
+	 * nothing is pushed until the flag is set */
+	while (pop_spsc_ring(&sensors[sensor].echo_queue, &echo_us));
+	sensors[sensor].is_echo_reader_attached = 1;
+}
+
+void detach_ultrasound_echo_reader(uint8_t sensor)
+{
+	if (sensor >= ULTRASOUND_SENSOR_COUNT) return;
+
+	sensors[sensor].is_echo_reader_attached = 0;
+}
+
+uint32_t read_ultrasound_echoes(uint8_t sensor, uint32_t* echoes_us, uint32_t max_echoes)
+{
+	uint32_t count = 0;
+
+	if (sensor >= ULTRASOUND_SENSOR_COUNT) return 0;
+
+	/* Publish echoes from a batch the DMA has not finished yet */
+	request_capture_update();
+
+	while (count < max_echoes && pop_spsc_ring(&sensors[sensor].echo_queue, &echoes_us[count]))
+	{
+		count++;
+	}
+	return count;
+}
+
+uint32_t read_ultrasound_samples(ultrasound_sample_t* samples, uint32_t max_samples)
+{
+	uint32_t count = 0;
+
+	/* Publish echoes from a batch the DMA has not finished yet */
+	request_capture_update();
+
+	while (count < max_samples && pop_spsc_ring(&sample_queue, &samples[count]))
+	{
+		count++;
+	}
+	return count;
+}
+
+uint32_t get_ultrasound_echo_drops(uint8_t sensor)
+{
+	if (sensor >= ULTRASOUND_SENSOR_COUNT) return 0;
+
+	return get_spsc_ring_drops(&sensors[sensor].echo_queue);
+}
+
+uint32_t get_ultrasound_edge_overruns(uint8_t sensor)
+{
+	if (sensor >= ULTRASOUND_SENSOR_COUNT) return 0;
+
+	return sensors[sensor].edge_overruns;
+}
+
+uint32_t get_ultrasound_sample_drops()
+{
+	return get_spsc_ring_drops(&sample_queue);
+}
+
+uint8_t get_ultrasound_sample(
+	uint8_t sensor,
+	ultrasound_sample_t* sample,
+	uint32_t last_sequence
+)
+{
+	ultrasound_sensor_t* state;
+	uint32_t lock;
+
+	if (sensor >= ULTRASOUND_SENSOR_COUNT) return 0;
+	state = &sensors[sensor];
+
+	/* Publish echoes from a batch the DMA has not finished yet */
+	request_capture_update();
+
+	do
+	{
+		lock = state->sample_lock;
+		__DMB();
+		*sample = state->latest_sample;
+		__DMB();
+	} while ((lock & 1) || lock != state->sample_lock);
+
+	return sample->sequence != last_sequence;
+}
+
+uint8_t is_ultrasound_sample_stale(const ultrasound_sample_t* sample)
+{
+	return get_timestamp_us() - sample->timestamp_us > ULTRASOUND_SAMPLE_TIMEOUT_MS * 1000;
+}
+
+void set_ultrasound_ping_rate(uint32_t rate_hz)
+{
+	if (rate_hz == 0) return;
+
+	/* A single word store, the capture interrupt loads it into TIM5 */
+	requested_ping_period_us = 1000000 / rate_hz;
+	request_capture_update();
+}
+
+uint32_t get_ultrasound_ping_period_us()
+{
+	return (__HAL_TIM_GET_AUTORELOAD(&htim5) + 1) * ULTRASOUND_SENSOR_COUNT;
+}
+
+void set_ultrasound_burst_guard(uint32_t guard_us)
+{
+	burst_guard_us = guard_us;
+#if ULTRASOUND_BURST_MODE
+	/* Both registers are preloaded and swap on the next restart */
+	__HAL_TIM_SET_COMPARE(&htim5, TIM_CHANNEL_2, burst_guard_us);
+	__HAL_TIM_SET_AUTORELOAD(&htim5, burst_guard_us + ULTRASOUND_TRIGGER_PULSE_US);
+#endif
+}
+
+void process_ultrasound_requests()
+{
+	if (!is_capture_update_requested) return;
+
+	is_capture_update_requested = 0;
+	process_dma_edges();
+	update_ping_period();
+}
+
+__weak void ultrasound_sample_callback(uint8_t sensor)
+{
+	UNUSED(sensor);
+}
+
+/* Private Function Implementations */
+
+void process_edges(uint8_t sensor)
+{
+	const ultrasound_sensor_config_t* config = &sensor_configs[sensor];
+	ultrasound_sensor_t* state = &sensors[sensor];
+	uint32_t write_index;
+	uint32_t edge_count;
+	GPIO_PinState polarity;
+	uint32_t echo_us;
+	uint32_t timer_count;
+	uint64_t now_us;
+	uint64_t edge_us;
+#if ULTRASOUND_SYNC_CAPTURE
+	uint32_t edge;
+#else
+	uint32_t timer_period = __HAL_TIM_GET_AUTORELOAD(&htim2) + 1;
+#endif
+	uint8_t is_overrun = 0;
+#if ULTRASOUND_POLLED_CAPTURE
+	uint32_t half_flag;
+	uint32_t end_flag;
+#endif
+
+	/* Sample the newest edge and the line level without an edge in between */
+	if (config->dma != NULL)
+	{
+#if ULTRASOUND_POLLED_CAPTURE
+		/* Read before the counter, so a lap flag always lies behind it */
+		half_flag = __HAL_DMA_GET_FLAG(config->dma, __HAL_DMA_GET_HT_FLAG_INDEX(config->dma));
+		end_flag = __HAL_DMA_GET_FLAG(config->dma, __HAL_DMA_GET_TC_FLAG_INDEX(config->dma));
+#endif
+		do
+		{
+			write_index = __HAL_DMA_GET_COUNTER(config->dma);
+			timer_count = __HAL_TIM_GET_COUNTER(&htim2);
+			polarity = HAL_GPIO_ReadPin(config->echo_port, config->echo_pin);
+		} while (write_index != __HAL_DMA_GET_COUNTER(config->dma));
+		write_index = (ULTRASOUND_EDGE_RING_SIZE - write_index) % ULTRASOUND_EDGE_RING_SIZE;
+#if ULTRASOUND_POLLED_CAPTURE
+		__HAL_DMA_CLEAR_FLAG(config->dma,
+			__HAL_DMA_GET_HT_FLAG_INDEX(config->dma) | __HAL_DMA_GET_TC_FLAG_INDEX(config->dma));
+		is_overrun = is_edge_ring_overrun(state->edge_read_index, write_index,
+			half_flag != 0, end_flag != 0);
+#endif
+	}
+	else
+	{
+		/* Only reached from the capture interrupt of the newest edge */
+		write_index = state->edge_write_index;
+		timer_count = __HAL_TIM_GET_COUNTER(&htim2);
+		polarity = HAL_GPIO_ReadPin(config->echo_port, config->echo_pin);
+	}
+	now_us = get_timestamp_us();
+
+	if (is_overrun)
+	{
+		/* Only the newest edges are left, starting from the oldest of them */
+		state->edge_overruns++;
+		state->has_pending_rising_edge = 0;
+		state->edge_read_index = write_index;
+		edge_count = ULTRASOUND_EDGE_RING_SIZE;
+	}
+	else
+	{
+		edge_count = (write_index + ULTRASOUND_EDGE_RING_SIZE - state->edge_read_index)
+			% ULTRASOUND_EDGE_RING_SIZE;
+	}
+	if (edge_count == 0) return;
+
+	/* Walk back from the newest edge to the polarity of the oldest one */
+	if ((edge_count - 1) % 2 != 0)
+	{
+		polarity = (polarity == GPIO_PIN_SET) ? GPIO_PIN_RESET : GPIO_PIN_SET;
+	}
+
+#if ULTRASOUND_SYNC_CAPTURE
+	/* Every edge resets TIM2, so the counter is the time since the newest edge
+	 * and each capture the time since the edge before it. Walk back to just
+	 * before the oldest edge, each edge then adds its own capture. */
+	edge_us = now_us - timer_count;
+	for (edge = 0; edge < edge_count; edge++)
+	{
+		edge_us -= state->edge_ring[(state->edge_read_index + edge) % ULTRASOUND_EDGE_RING_SIZE];
+	}
+#endif
+
+	for (; edge_count > 0; edge_count--)
+	{
+#if ULTRASOUND_SYNC_CAPTURE
+		edge_us += state->edge_ring[state->edge_read_index];
+#else
+		/* TIM2 runs free, so the age of a capture is its distance to the counter */
+		edge_us = now_us - (timer_count + timer_period - state->edge_ring[state->edge_read_index])
+			% timer_period;
+#endif
+		if (polarity == EDGE_RISING)
+		{
+			state->pending_rising_edge = state->edge_ring[state->edge_read_index];
+			state->has_pending_rising_edge = 1;
+		}
+		else if (state->has_pending_rising_edge)
+		{
+#if ULTRASOUND_SYNC_CAPTURE
+			/* TIM2 was reset by the rising edge */
+			echo_us = state->edge_ring[state->edge_read_index];
+#else
+			echo_us = state->edge_ring[state->edge_read_index] - state->pending_rising_edge;
+			/* Account for TIM2 wrapping between the two edges */
+			if (state->edge_ring[state->edge_read_index] < state->pending_rising_edge)
+			{
+				echo_us += timer_period;
+			}
+#endif
+			push_echo(sensor, echo_us, edge_us);
+			state->has_pending_rising_edge = 0;
+		}
+
+		polarity = (polarity == GPIO_PIN_SET) ? GPIO_PIN_RESET : GPIO_PIN_SET;
+		state->edge_read_index = (state->edge_read_index + 1) % ULTRASOUND_EDGE_RING_SIZE;
+	}
+}
+
+uint8_t is_edge_ring_overrun(
+	uint32_t read_index,
+	uint32_t write_index,
+	uint8_t has_passed_half,
+	uint8_t has_passed_end
+)
+{
+	uint32_t edge_count = (write_index + ULTRASOUND_EDGE_RING_SIZE - read_index)
+		% ULTRASOUND_EDGE_RING_SIZE;
+	uint32_t to_half = (ULTRASOUND_EDGE_RING_SIZE / 2 + ULTRASOUND_EDGE_RING_SIZE - read_index)
+		% ULTRASOUND_EDGE_RING_SIZE;
+	uint32_t to_end = (ULTRASOUND_EDGE_RING_SIZE - read_index) % ULTRASOUND_EDGE_RING_SIZE;
+
+	/* A distance of 0 would take a whole lap to pass */
+	if (has_passed_half && (to_half == 0 || to_half > edge_count)) return 1;
+	if (has_passed_end && (to_end == 0 || to_end > edge_count)) return 1;
+	return 0;
+}
+
+void process_dma_edges()
+{
+	uint8_t sensor;
+
+	for (sensor = 0; sensor < ULTRASOUND_SENSOR_COUNT; sensor++)
+	{
+		if (sensor_configs[sensor].dma != NULL) process_edges(sensor);
+	}
+}
+
+void request_capture_update()
+{
+	is_capture_update_requested = 1;
+	HAL_NVIC_SetPendingIRQ(TIM2_IRQn);
+	/* Let the pended interrupt in before the caller reads on */
+	__DSB();
+	__ISB();
+}
+
+void push_echo(uint8_t sensor, uint32_t echo_us, uint64_t timestamp_us)
+{
+	ultrasound_sensor_t* state = &sensors[sensor];
+
+	last_read_us = echo_us;
+	state->last_read_us = echo_us;
+	if (state->is_echo_reader_attached) push_spsc_ring(&state->echo_queue, &echo_us);
+	publish_sample(sensor, echo_us, timestamp_us);
+	/* A closer or further object moves the re-trigger bound */
+	update_ping_period();
+}
+
+void publish_sample(uint8_t sensor, uint32_t echo_us, uint64_t timestamp_us)
+{
+	ultrasound_sensor_t* state = &sensors[sensor];
+	ultrasound_sample_t* sample = &state->latest_sample;
+
+	state->sample_lock++;
+	__DMB();
+	sample->sequence++;
+	sample->sensor = sensor;
+	sample->timestamp_us = timestamp_us;
+	sample->echo_us = echo_us;
+	sample->distance_mm = ultrasound_echo_to_mm(echo_us);
+	if (echo_us >= ULTRASOUND_ECHO_TIMEOUT_US)
+	{
+		sample->status = ULTRASOUND_SAMPLE_TIMEOUT;
+	}
+	else if (echo_us < ULTRASOUND_MIN_RANGE_US || echo_us > ULTRASOUND_MAX_RANGE_US)
+	{
+		sample->status = ULTRASOUND_SAMPLE_OUT_OF_RANGE;
+	}
+	else
+	{
+		sample->status = ULTRASOUND_SAMPLE_OK;
+	}
+	__DMB();
+	state->sample_lock++;
+	push_spsc_ring(&sample_queue, sample);
+	ultrasound_sample_callback(sensor);
+}
+
+void update_ping_period()
+{
+#if !ULTRASOUND_BURST_MODE
+	uint32_t period_us = requested_ping_period_us / ULTRASOUND_SENSOR_COUNT;
+	uint32_t longest_echo_us = 0;
+	uint32_t min_period_us;
+	uint8_t sensor;
+
+	/* Any sensor may be next in turn, so leave room for the longest echo */
+	for (sensor = 0; sensor < ULTRASOUND_SENSOR_COUNT; sensor++)
+	{
+		if (sensors[sensor].last_read_us > longest_echo_us)
+		{
+			longest_echo_us = sensors[sensor].last_read_us;
+		}
+	}
+	min_period_us = ULTRASOUND_TRIGGER_TO_ECHO_US
+		+ longest_echo_us
+		+ ULTRASOUND_RETRIGGER_GUARD_US;
+
+	if (period_us < min_period_us) period_us = min_period_us;
+	/* TIM5 counts at 1 MHz, ARR is one less than the period */
+	if (period_us - 1 != __HAL_TIM_GET_AUTORELOAD(&htim5))
+	{
+		__HAL_TIM_SET_AUTORELOAD(&htim5, period_us - 1);
+	}
+#endif
+}
+
+void configure_sensor_array()
+{
+	GPIO_InitTypeDef gpio_config = {0};
+	TIM_IC_InitTypeDef ic_config = {0};
+	TIM_OC_InitTypeDef oc_config = {0};
+	uint8_t sensor;
+
+	__HAL_RCC_GPIOA_CLK_ENABLE();
+	__HAL_RCC_GPIOB_CLK_ENABLE();
+	gpio_config.Mode = GPIO_MODE_AF_PP;
+	gpio_config.Pull = GPIO_NOPULL;
+	gpio_config.Speed = GPIO_SPEED_FREQ_LOW;
+
+	/* Same edges as sensor 0 in MX_TIM2_Init() */
+	ic_config.ICPolarity = TIM_INPUTCHANNELPOLARITY_BOTHEDGE;
+	ic_config.ICSelection = TIM_ICSELECTION_DIRECTTI;
+	ic_config.ICPrescaler = TIM_ICPSC_DIV1;
+	ic_config.ICFilter = 0;
+
+	/* Same pulse as sensor 0 in MX_TIM5_Init(), but only on its turn */
+	oc_config.OCMode = TIM_OCMODE_PWM1;
+	oc_config.Pulse = 0;
+	oc_config.OCPolarity = TIM_OCPOLARITY_HIGH;
+	oc_config.OCFastMode = TIM_OCFAST_DISABLE;
+	if (HAL_TIM_PWM_ConfigChannel(&htim5, &oc_config, sensor_configs[0].trigger_channel) != HAL_OK)
+	{
+		Error_Handler();
+	}
+
+#if ULTRASOUND_SENSOR_COUNT > 3
+	/* PA0 becomes the fourth trigger below, the first echo moves to PA15 */
+	gpio_config.Pin = SENSOR_0_ECHO_Pin;
+	gpio_config.Alternate = GPIO_AF1_TIM2;
+	HAL_GPIO_Init(SENSOR_0_ECHO_GPIO_Port, &gpio_config);
+#endif
+
+	for (sensor = 1; sensor < ULTRASOUND_SENSOR_COUNT; sensor++)
+	{
+		const ultrasound_sensor_config_t* config = &sensor_configs[sensor];
+
+		gpio_config.Pin = config->echo_pin;
+		gpio_config.Alternate = GPIO_AF1_TIM2;
+		HAL_GPIO_Init(config->echo_port, &gpio_config);
+		gpio_config.Pin = config->trigger_pin;
+		gpio_config.Alternate = GPIO_AF2_TIM5;
+		HAL_GPIO_Init(config->trigger_port, &gpio_config);
+
+		if (HAL_TIM_IC_ConfigChannel(&htim2, &ic_config, config->capture_channel) != HAL_OK)
+		{
+			Error_Handler();
+		}
+		if (HAL_TIM_PWM_ConfigChannel(&htim5, &oc_config, config->trigger_channel) != HAL_OK)
+		{
+			Error_Handler();
+		}
+	}
+
+#if ULTRASOUND_SENSOR_COUNT > 2
+	/* TIM2 CH3 is request 4 on DMA1 channel 1, set up the same as CH1 */
+	hdma_tim2_ch3.Instance = DMA1_Channel1;
+	hdma_tim2_ch3.Init.Request = DMA_REQUEST_4;
+	hdma_tim2_ch3.Init.Direction = DMA_PERIPH_TO_MEMORY;
+	hdma_tim2_ch3.Init.PeriphInc = DMA_PINC_DISABLE;
+	hdma_tim2_ch3.Init.MemInc = DMA_MINC_ENABLE;
+	hdma_tim2_ch3.Init.PeriphDataAlignment = DMA_PDATAALIGN_WORD;
+	hdma_tim2_ch3.Init.MemDataAlignment = DMA_MDATAALIGN_WORD;
+	hdma_tim2_ch3.Init.Mode = DMA_CIRCULAR;
+	hdma_tim2_ch3.Init.Priority = DMA_PRIORITY_LOW;
+	if (HAL_DMA_Init(&hdma_tim2_ch3) != HAL_OK)
+	{
+		Error_Handler();
+	}
+	__HAL_LINKDMA(&htim2, hdma[TIM_DMA_ID_CC3], hdma_tim2_ch3);
+	HAL_NVIC_SetPriority(DMA1_Channel1_IRQn, ACQUISITION_IRQ_PRIORITY, 0);
+	HAL_NVIC_EnableIRQ(DMA1_Channel1_IRQn);
+#endif
+
+	HAL_NVIC_SetPriority(TIM5_IRQn, ACQUISITION_IRQ_PRIORITY, 0);
+	HAL_NVIC_EnableIRQ(TIM5_IRQn);
+}
+
+void start_polled_capture(uint8_t sensor)
+{
+	const ultrasound_sensor_config_t* config = &sensor_configs[sensor];
+	/* CCR1 to CCR4 are consecutive words, TIM_CHANNEL_n is their offset */
+	uint32_t capture_register = (uint32_t)&htim2.Instance->CCR1 + config->capture_channel;
+	uint32_t dma_request = TIM_DMA_CC1 << (config->capture_channel >> 2);
+
+	HAL_NVIC_DisableIRQ(DMA1_Channel5_IRQn);
+	HAL_NVIC_DisableIRQ(DMA1_Channel1_IRQn);
+	if (HAL_DMA_Start(config->dma, capture_register,
+		(uint32_t)sensors[sensor].edge_ring, ULTRASOUND_EDGE_RING_SIZE) != HAL_OK)
+	{
+		Error_Handler();
+	}
+	__HAL_TIM_ENABLE_DMA(&htim2, dma_request);
+	TIM_CCxChannelCmd(htim2.Instance, config->capture_channel, TIM_CCx_ENABLE);
+	__HAL_TIM_ENABLE(&htim2);
+}
+
+void hand_over_trigger()
+{
+	__HAL_TIM_SET_COMPARE(&htim5, sensor_configs[next_trigger_sensor].trigger_channel, 0);
+	next_trigger_sensor = (next_trigger_sensor + 1) % ULTRASOUND_SENSOR_COUNT;
+	__HAL_TIM_SET_COMPARE(&htim5, sensor_configs[next_trigger_sensor].trigger_channel,
+		ULTRASOUND_TRIGGER_PULSE_US);
+}
+
+void configure_sync_capture()
+{
+	TIM_SlaveConfigTypeDef slave_config = {0};
+
+	slave_config.SlaveMode = TIM_SLAVEMODE_RESET;
+	slave_config.InputTrigger = TIM_TS_TI1FP1;
+	/* Matches the both edge polarity of the CH1 input capture */
+	slave_config.TriggerPolarity = TIM_TRIGGERPOLARITY_BOTHEDGE;
+	slave_config.TriggerFilter = 0;
+	if (HAL_TIM_SlaveConfigSynchro(&htim2, &slave_config) != HAL_OK)
+	{
+		Error_Handler();
+	}
+}
+
+void configure_burst_trigger()
+{
+	TIM_MasterConfigTypeDef master_config = {0};
+	TIM_SlaveConfigTypeDef slave_config = {0};
+	TIM_OC_InitTypeDef oc_config = {0};
+
+	master_config.MasterOutputTrigger = TIM_TRGO_UPDATE;
+	master_config.MasterSlaveMode = TIM_MASTERSLAVEMODE_DISABLE;
+	if (HAL_TIMEx_MasterConfigSynchronization(&htim2, &master_config) != HAL_OK)
+	{
+		Error_Handler();
+	}
+
+	/* TIM5 ITR0 is TIM2 TRGO */
+	slave_config.SlaveMode = TIM_SLAVEMODE_COMBINED_RESETTRIGGER;
+	slave_config.InputTrigger = TIM_TS_ITR0;
+	if (HAL_TIM_SlaveConfigSynchro(&htim5, &slave_config) != HAL_OK)
+	{
+		Error_Handler();
+	}
+
+	/* PWM2 keeps the trigger low until the guard time has passed */
+	oc_config.OCMode = TIM_OCMODE_PWM2;
+	oc_config.Pulse = burst_guard_us;
+	oc_config.OCPolarity = TIM_OCPOLARITY_HIGH;
+	oc_config.OCFastMode = TIM_OCFAST_DISABLE;
+	if (HAL_TIM_PWM_ConfigChannel(&htim5, &oc_config, TIM_CHANNEL_2) != HAL_OK)
+	{
+		Error_Handler();
+	}
+	__HAL_TIM_SET_AUTORELOAD(&htim5, burst_guard_us + ULTRASOUND_TRIGGER_PULSE_US);
+	SET_BIT(htim5.Instance->CR1, TIM_CR1_OPM);
+}
+
+/* DMA half transfer: the first half of an edge ring is full */
+void HAL_TIM_IC_CaptureHalfCpltCallback(TIM_HandleTypeDef *htim)
+{
+	/* Only htim2 is configured for callbacks */
+	process_dma_edges();
+}
+
+/* DMA transfer complete, or a single edge of an interrupt captured sensor */
 void HAL_TIM_IC_CaptureCallback(TIM_HandleTypeDef *htim)
 {
 	/* Only htim2 is configured for callbacks */
-	last_read_us = timer_triggers_us[1] - timer_triggers_us[0];
+	uint8_t sensor;
+
+	for (sensor = 0; sensor < ULTRASOUND_SENSOR_COUNT; sensor++)
+	{
+		const ultrasound_sensor_config_t* config = &sensor_configs[sensor];
+		ultrasound_sensor_t* state = &sensors[sensor];
+
+		/* TIM_CHANNEL_n is 4 * (n - 1), HAL_TIM_ACTIVE_CHANNEL_n is 1 << (n - 1) */
+		if (htim->Channel != (1U << (config->capture_channel >> 2))) continue;
+
+		if (config->dma == NULL)
+		{
+			state->edge_ring[state->edge_write_index] =
+				HAL_TIM_ReadCapturedValue(htim, config->capture_channel);
+			state->edge_write_index = (state->edge_write_index + 1) % ULTRASOUND_EDGE_RING_SIZE;
+		}
+		process_edges(sensor);
+	}
 }
 
-void HAL_TIM_IC_CaptureHalfCpltCallback(TIM_HandleTypeDef *htim)
+/* TIM5 update: the sensor preloaded last period is pinging now */
+void HAL_TIM_PeriodElapsedCallback(TIM_HandleTypeDef *htim)
 {
-//	htim->Instance->CNT = 0;
+	if (htim->Instance == TIM5) hand_over_trigger();
 }
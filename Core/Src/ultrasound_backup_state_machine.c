@@ -0,0 +1,59 @@
+#include "ultrasound_backup_state_machine.h"
+
+/* Set while the critical alert flashes the red LED */
+volatile uint8_t critical_alert_flashing = 0;
+
+/* State Machine Function Implementation */
+void no_alert_func()
+{
+	set_ultrasound_ping_rate(NO_ALERT_PING_RATE_HZ);
+	HAL_GPIO_WritePin(RED_LED_GPIO_Port, RED_LED_Pin, GPIO_PIN_RESET);
+	HAL_GPIO_WritePin(GREEN_LED_GPIO_Port, GREEN_LED_Pin, GPIO_PIN_RESET);
+}
+
+void low_alert_func()
+{
+	set_ultrasound_ping_rate(LOW_ALERT_PING_RATE_HZ);
+	HAL_GPIO_WritePin(RED_LED_GPIO_Port, RED_LED_Pin, GPIO_PIN_RESET);
+	HAL_GPIO_WritePin(GREEN_LED_GPIO_Port, GREEN_LED_Pin, GPIO_PIN_SET);
+}
+
+void medium_alert_func()
+{
+	set_ultrasound_ping_rate(MEDIUM_ALERT_PING_RATE_HZ);
+	HAL_GPIO_WritePin(RED_LED_GPIO_Port, RED_LED_Pin, GPIO_PIN_SET);
+	HAL_GPIO_WritePin(GREEN_LED_GPIO_Port, GREEN_LED_Pin, GPIO_PIN_SET);
+}
+
+void high_alert_func()
+{
+	set_ultrasound_ping_rate(HIGH_ALERT_PING_RATE_HZ);
+	HAL_GPIO_WritePin(RED_LED_GPIO_Port, RED_LED_Pin, GPIO_PIN_SET);
+	HAL_GPIO_WritePin(GREEN_LED_GPIO_Port, GREEN_LED_Pin, GPIO_PIN_RESET);
+}
+
+void critical_alert_func()
+{
+	set_ultrasound_ping_rate(CRITICAL_ALERT_PING_RATE_HZ);
+	/* The red flashing portion is handled by flash_critical_alert(). */
+	HAL_GPIO_WritePin(GREEN_LED_GPIO_Port, GREEN_LED_Pin, GPIO_PIN_RESET);
+	critical_alert_flashing = 1;
+}
+
+void critical_alert_exit_func()
+{
+	critical_alert_flashing = 0;
+}
+
+void flash_critical_alert()
+{
+	uint32_t primask = __get_PRIMASK();
+
+	/* The alert must not be left between the check and the toggle */
+	__disable_irq();
+	if (critical_alert_flashing)
+	{
+		HAL_GPIO_TogglePin(RED_LED_GPIO_Port, RED_LED_Pin);
+	}
+	__set_PRIMASK(primask);
+}
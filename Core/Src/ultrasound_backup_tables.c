@@ -0,0 +1,131 @@
+/* Generated by Tools/state_machine_compiler.py from Tools/ultrasound_backup.sm, do not edit */
+#include "ultrasound_backup_tables.h"
+
+/* States */
+static const state_machine_state_t no_alert_state =
+{
+	.state = NO_ALERT,
+	.parent = NULL,
+	.on_enter = no_alert_func,
+	.on_exit = NULL,
+	.on_tick = NULL,
+	.transitions =
+	{
+		{{STATE_MACHINE_GUARD(DISTANCE_SIGNAL, LT_EQUALS, CRITICAL_ALERT_MM),
+			STATE_MACHINE_GUARD(TIME_TO_COLLISION_SIGNAL, LT_EQUALS, CRITICAL_ALERT_TTC_MS)},
+			GUARD_OR, CRITICAL_ALERT, STATE_MACHINE_NO_FUNC,
+			HYSTERESIS_DISABLED, STATE_MACHINE_NO_DWELL},
+		{{STATE_MACHINE_GUARD(DISTANCE_SIGNAL, LT_EQUALS, LOW_ALERT_MM), STATE_MACHINE_NO_GUARD},
+			GUARD_SINGLE, LOW_ALERT, STATE_MACHINE_NO_FUNC,
+			STATE_MACHINE_CONFIG_HYSTERESIS, STATE_MACHINE_NO_DWELL},
+		STATE_MACHINE_TRANSITION_TERMINATOR_DECL
+	}
+};
+
+static const state_machine_state_t low_alert_state =
+{
+	.state = LOW_ALERT,
+	.parent = NULL,
+	.on_enter = low_alert_func,
+	.on_exit = NULL,
+	.on_tick = NULL,
+	.transitions =
+	{
+		{{STATE_MACHINE_GUARD(DISTANCE_SIGNAL, LT_EQUALS, CRITICAL_ALERT_MM),
+			STATE_MACHINE_GUARD(TIME_TO_COLLISION_SIGNAL, LT_EQUALS, CRITICAL_ALERT_TTC_MS)},
+			GUARD_OR, CRITICAL_ALERT, STATE_MACHINE_NO_FUNC,
+			HYSTERESIS_DISABLED, STATE_MACHINE_NO_DWELL},
+		{{STATE_MACHINE_GUARD(DISTANCE_SIGNAL, GREATER_THAN, LOW_ALERT_MM), STATE_MACHINE_NO_GUARD},
+			GUARD_SINGLE, NO_ALERT, STATE_MACHINE_NO_FUNC,
+			STATE_MACHINE_CONFIG_HYSTERESIS, STATE_MACHINE_DWELL_US(ALERT_CLEAR_DWELL_MS * 1000)},
+		{{STATE_MACHINE_GUARD(DISTANCE_SIGNAL, LT_EQUALS, MEDIUM_ALERT_MM), STATE_MACHINE_NO_GUARD},
+			GUARD_SINGLE, MEDIUM_ALERT, STATE_MACHINE_NO_FUNC,
+			STATE_MACHINE_CONFIG_HYSTERESIS, STATE_MACHINE_NO_DWELL},
+		STATE_MACHINE_TRANSITION_TERMINATOR_DECL
+	}
+};
+
+static const state_machine_state_t medium_alert_state =
+{
+	.state = MEDIUM_ALERT,
+	.parent = NULL,
+	.on_enter = medium_alert_func,
+	.on_exit = NULL,
+	.on_tick = NULL,
+	.transitions =
+	{
+		{{STATE_MACHINE_GUARD(DISTANCE_SIGNAL, LT_EQUALS, CRITICAL_ALERT_MM),
+			STATE_MACHINE_GUARD(TIME_TO_COLLISION_SIGNAL, LT_EQUALS, CRITICAL_ALERT_TTC_MS)},
+			GUARD_OR, CRITICAL_ALERT, STATE_MACHINE_NO_FUNC,
+			HYSTERESIS_DISABLED, STATE_MACHINE_NO_DWELL},
+		{{STATE_MACHINE_GUARD(DISTANCE_SIGNAL, GREATER_THAN, MEDIUM_ALERT_MM), STATE_MACHINE_NO_GUARD},
+			GUARD_SINGLE, LOW_ALERT, STATE_MACHINE_NO_FUNC,
+			STATE_MACHINE_CONFIG_HYSTERESIS, STATE_MACHINE_DWELL_US(ALERT_CLEAR_DWELL_MS * 1000)},
+		{{STATE_MACHINE_GUARD(DISTANCE_SIGNAL, LT_EQUALS, HIGH_ALERT_MM), STATE_MACHINE_NO_GUARD},
+			GUARD_SINGLE, HIGH_ALERT, STATE_MACHINE_NO_FUNC,
+			STATE_MACHINE_CONFIG_HYSTERESIS, STATE_MACHINE_NO_DWELL},
+		STATE_MACHINE_TRANSITION_TERMINATOR_DECL
+	}
+};
+
+static const state_machine_state_t high_alert_state =
+{
+	.state = HIGH_ALERT,
+	.parent = NULL,
+	.on_enter = high_alert_func,
+	.on_exit = NULL,
+	.on_tick = NULL,
+	.transitions =
+	{
+		{{STATE_MACHINE_GUARD(DISTANCE_SIGNAL, LT_EQUALS, CRITICAL_ALERT_MM),
+			STATE_MACHINE_GUARD(TIME_TO_COLLISION_SIGNAL, LT_EQUALS, CRITICAL_ALERT_TTC_MS)},
+			GUARD_OR, CRITICAL_ALERT, STATE_MACHINE_NO_FUNC,
+			STATE_MACHINE_CONFIG_HYSTERESIS, STATE_MACHINE_NO_DWELL},
+		{{STATE_MACHINE_GUARD(DISTANCE_SIGNAL, GREATER_THAN, HIGH_ALERT_MM), STATE_MACHINE_NO_GUARD},
+			GUARD_SINGLE, MEDIUM_ALERT, STATE_MACHINE_NO_FUNC,
+			STATE_MACHINE_CONFIG_HYSTERESIS, STATE_MACHINE_DWELL_US(ALERT_CLEAR_DWELL_MS * 1000)},
+		STATE_MACHINE_TRANSITION_TERMINATOR_DECL
+	}
+};
+
+static const state_machine_state_t critical_alert_state =
+{
+	.state = CRITICAL_ALERT,
+	.parent = NULL,
+	.on_enter = critical_alert_func,
+	.on_exit = critical_alert_exit_func,
+	.on_tick = NULL,
+	.transitions =
+	{
+		{{STATE_MACHINE_GUARD(DISTANCE_SIGNAL, GREATER_THAN, CRITICAL_ALERT_MM),
+			STATE_MACHINE_GUARD(TIME_TO_COLLISION_SIGNAL, GREATER_THAN, CRITICAL_ALERT_TTC_MS)},
+			GUARD_AND, HIGH_ALERT, STATE_MACHINE_NO_FUNC,
+			STATE_MACHINE_CONFIG_HYSTERESIS, STATE_MACHINE_DWELL_US(ALERT_CLEAR_DWELL_MS * 1000)},
+		STATE_MACHINE_TRANSITION_TERMINATOR_DECL
+	}
+};
+
+/* State Machine State Pointer-Array */
+static const state_machine_state_t* const ultrasound_backup_states[ULTRASOUND_BACKUP_END_STATE] =
+{
+	&no_alert_state,
+	&low_alert_state,
+	&medium_alert_state,
+	&high_alert_state,
+	&critical_alert_state
+};
+
+#if STATE_MACHINE_BAND_LUT
+/* Band lookup table compiled from the states above */
+static state_machine_band_lut_t ultrasound_backup_band_lut;
+#endif
+
+/* Final State Machine Configuration */
+const state_machine_config_t ultrasound_backup_config =
+{
+	.hysteresis = HYSTERESIS,
+	.state_machine = ultrasound_backup_states,
+#if STATE_MACHINE_BAND_LUT
+	.band_lut = &ultrasound_backup_band_lut,
+#endif
+};
@@ -0,0 +1,255 @@
+/* Checks update_state_machine_batch() against one update per sample.
+ *
+ * The backup alert machine runs 20 random seeds through both, every seed
+ * in one of the three action modes. The events have to list the same
+ * transitions the single updates took, and the batch has to end in the same
+ * state. An event list of BATCH_MAX_EVENTS makes the batch stop and resume
+ * many times per seed. IMMEDIATE has to make the same hook calls, DEFERRED
+ * the same ping rate changes.
+ *
+ * A small hierarchical machine then checks IMMEDIATE runs the enter, exit
+ * and tick hooks of nested states in the same order as single updates.
+ */
+#include <stdio.h>
+#include <string.h>
+#include "engine_api.h"
+#include "random_params.h"
+
+/* Hook side effects counted by the stubs */
+extern int gpio_writes;
+extern int ping_rate_sets;
+
+#define BATCH_SEEDS 20
+#define BATCH_MAX_EVENTS 7
+#define HIERARCHY_SAMPLES 2000
+
+static state_machine_params_t params[RANDOM_PARAMS_LENGTH];
+static state_machine_event_t single_events[RANDOM_PARAMS_LENGTH];
+static state_machine_event_t batch_events[RANDOM_PARAMS_LENGTH];
+
+/* Log of the hooks the hierarchical machine ran */
+static char hook_log[HIERARCHY_SAMPLES * 64];
+static size_t hook_log_length;
+
+#define LOGGING_HOOK(name) \
+	static void name(void) \
+	{ \
+		hook_log_length += (size_t)snprintf(hook_log + hook_log_length, \
+			sizeof(hook_log) - hook_log_length, " " #name); \
+	}
+LOGGING_HOOK(idle_enter)
+LOGGING_HOOK(idle_exit)
+LOGGING_HOOK(active_enter)
+LOGGING_HOOK(active_exit)
+LOGGING_HOOK(active_tick)
+LOGGING_HOOK(slow_enter)
+LOGGING_HOOK(slow_exit)
+LOGGING_HOOK(fast_enter)
+LOGGING_HOOK(fast_exit)
+
+/* IDLE, then ACTIVE with the children SLOW and FAST. Signal 0 is a speed,
+ * signal 1 a stop request ACTIVE handles for both children. */
+static const state_machine_state_t idle_state =
+{
+	.state = 0,
+	.on_enter = idle_enter,
+	.on_exit = idle_exit,
+	.transitions =
+	{
+		{{STATE_MACHINE_GUARD(1, EQUAL, 0), STATE_MACHINE_NO_GUARD},
+			GUARD_SINGLE, 2, STATE_MACHINE_NO_FUNC},
+		STATE_MACHINE_TRANSITION_TERMINATOR_DECL
+	}
+};
+
+static const state_machine_state_t active_state =
+{
+	.state = 1,
+	.on_enter = active_enter,
+	.on_exit = active_exit,
+	.on_tick = active_tick,
+	.transitions =
+	{
+		{{STATE_MACHINE_GUARD(1, GREATER_THAN, 0), STATE_MACHINE_NO_GUARD},
+			GUARD_SINGLE, 0, STATE_MACHINE_NO_FUNC},
+		STATE_MACHINE_TRANSITION_TERMINATOR_DECL
+	}
+};
+
+static const state_machine_state_t slow_state =
+{
+	.state = 2,
+	.parent = &active_state,
+	.on_enter = slow_enter,
+	.on_exit = slow_exit,
+	.transitions =
+	{
+		{{STATE_MACHINE_GUARD(0, GREATER_THAN, 100), STATE_MACHINE_NO_GUARD},
+			GUARD_SINGLE, 3, STATE_MACHINE_NO_FUNC},
+		STATE_MACHINE_TRANSITION_TERMINATOR_DECL
+	}
+};
+
+static const state_machine_state_t fast_state =
+{
+	.state = 3,
+	.parent = &active_state,
+	.on_enter = fast_enter,
+	.on_exit = fast_exit,
+	.transitions =
+	{
+		{{STATE_MACHINE_GUARD(0, LT_EQUALS, 100), STATE_MACHINE_NO_GUARD},
+			GUARD_SINGLE, 2, STATE_MACHINE_NO_FUNC},
+		{{STATE_MACHINE_GUARD(0, LT_EQUALS, 10), STATE_MACHINE_NO_GUARD},
+			GUARD_SINGLE, 1, STATE_MACHINE_NO_FUNC},
+		STATE_MACHINE_TRANSITION_TERMINATOR_DECL
+	}
+};
+
+static const state_machine_state_t* const hierarchy_states[] =
+{
+	&idle_state,
+	&active_state,
+	&slow_state,
+	&fast_state
+};
+
+static state_machine_hierarchy_t hierarchy;
+
+static const state_machine_config_t hierarchy_config =
+{
+	.hysteresis = HYSTERESIS_DISABLED,
+	.state_machine = hierarchy_states,
+	.hierarchy = &hierarchy
+};
+
+/* Runs the samples through a batch that resumes after every full event list */
+static int run_batch(state_machine_t* machine, const state_machine_params_t* samples, int count,
+	state_machine_actions_t actions, state_machine_event_t* events)
+{
+	int event_count = 0;
+	int start = 0;
+
+	while (start < count)
+	{
+		uint16_t written = update_state_machine_batch(machine, samples + start,
+			(uint16_t)(count - start), actions, events + event_count, BATCH_MAX_EVENTS);
+		int i;
+
+		for (i = 0; i < written; i++) events[event_count + i].sample += start;
+		event_count += written;
+		if (written < BATCH_MAX_EVENTS) break;
+		start = events[event_count - 1].sample + 1;
+	}
+	return event_count;
+}
+
+static int check_alert_machine(unsigned seed)
+{
+	state_machine_actions_t actions = (state_machine_actions_t)(seed % 3);
+	state_machine_t single = {0};
+	state_machine_t batch = {0};
+	int single_gpio_writes;
+	int single_ping_rate_sets;
+	int single_count = 0;
+	int batch_count;
+	int i;
+
+	make_random_params(seed, params, RANDOM_PARAMS_LENGTH);
+
+	gpio_writes = 0;
+	ping_rate_sets = 0;
+	initialize_state_machine(&single, &ENGINE_CONFIG);
+	for (i = 0; i < RANDOM_PARAMS_LENGTH; i++)
+	{
+		uint8_t from = single.current_state->state;
+		uint8_t to = update_state_machine(&single, &params[i]);
+
+		if (to != from)
+		{
+			single_events[single_count].sample = i;
+			single_events[single_count].from = from;
+			single_events[single_count].to = to;
+			single_count++;
+		}
+	}
+	single_gpio_writes = gpio_writes;
+	single_ping_rate_sets = ping_rate_sets;
+
+	gpio_writes = 0;
+	ping_rate_sets = 0;
+	initialize_state_machine(&batch, &ENGINE_CONFIG);
+	batch_count = run_batch(&batch, params, RANDOM_PARAMS_LENGTH, actions, batch_events);
+
+	if (batch_count != single_count || batch.current_state != single.current_state)
+	{
+		printf("seed %u: %d events and %d single transitions\n", seed, batch_count, single_count);
+		return 0;
+	}
+	for (i = 0; i < single_count; i++)
+	{
+		if (batch_events[i].sample != single_events[i].sample ||
+			batch_events[i].from != single_events[i].from ||
+			batch_events[i].to != single_events[i].to)
+		{
+			printf("seed %u: event %d differs\n", seed, i);
+			return 0;
+		}
+	}
+	if (actions == STATE_MACHINE_ACTIONS_IMMEDIATE &&
+		(gpio_writes != single_gpio_writes || ping_rate_sets != single_ping_rate_sets))
+	{
+		printf("seed %u: immediate hooks differ\n", seed);
+		return 0;
+	}
+	if (actions == STATE_MACHINE_ACTIONS_DEFERRED && ping_rate_sets != single_ping_rate_sets)
+	{
+		printf("seed %u: deferred hooks differ\n", seed);
+		return 0;
+	}
+	return 1;
+}
+
+static int check_hierarchy(void)
+{
+	static char single_log[sizeof(hook_log)];
+	state_machine_t machine = {0};
+	int i;
+
+	srand(1);
+	for (i = 0; i < HIERARCHY_SAMPLES; i++)
+	{
+		params[i].signals[0] = rand() % 200;
+		params[i].signals[1] = (rand() % 8 == 0);
+	}
+
+	hook_log_length = 0;
+	initialize_state_machine(&machine, &hierarchy_config);
+	for (i = 0; i < HIERARCHY_SAMPLES; i++) update_state_machine(&machine, &params[i]);
+	memcpy(single_log, hook_log, hook_log_length + 1);
+
+	memset(&machine, 0, sizeof(machine));
+	hook_log_length = 0;
+	initialize_state_machine(&machine, &hierarchy_config);
+	run_batch(&machine, params, HIERARCHY_SAMPLES, STATE_MACHINE_ACTIONS_IMMEDIATE, batch_events);
+
+	if (strcmp(single_log, hook_log) != 0)
+	{
+		printf("hierarchy: immediate hook order differs\n");
+		return 0;
+	}
+	return 1;
+}
+
+int main(void)
+{
+	unsigned seed;
+
+	for (seed = 1; seed <= BATCH_SEEDS; seed++)
+	{
+		if (!check_alert_machine(seed)) return 1;
+	}
+	if (!check_hierarchy()) return 1;
+	printf("batch agrees with single updates on %d seeds and the hierarchy\n", BATCH_SEEDS);
+	return 0;
+}
@@ -0,0 +1,64 @@
+/* Times update_state_machine() over the range trace on the host.
+ *
+ * Reports the mean time stamp counter cycles per update of the quickest of
+ * 20 passes, so a pass the host interrupted does not count. Host cycles
+ * only rank engine changes against each other, the target figure is the
+ * DWT count main prints. With -DBENCH_CPP the C++ engine of cpp_engine.cpp
+ * is timed the same way. See engine_api.h for building it against older
+ * trees.
+ */
+#include <stdio.h>
+#include <x86intrin.h>
+#include "engine_api.h"
+#include "range_trace.h"
+
+#define BENCH_PASSES 20
+
+state_machine_state_enum_t initialize_cpp_machine(void);
+state_machine_state_enum_t update_cpp_machine(const state_machine_params_t* params);
+
+/* Times one update expression over every pass, leaves the best mean in result */
+#define BENCH(update, result) \
+	do \
+	{ \
+		unsigned long long best = ~0ULL; \
+		int pass; \
+		int i; \
+		for (pass = 0; pass < BENCH_PASSES; pass++) \
+		{ \
+			unsigned long long total = 0; \
+			for (i = 0; i < RANGE_TRACE_LENGTH; i++) \
+			{ \
+				unsigned long long start; \
+				params.signals[DISTANCE_SIGNAL] = range_trace_mm[i]; \
+				SET_ENGINE_TIMESTAMP(&params, \
+					(uint64_t)(pass * RANGE_TRACE_LENGTH + i) * RANGE_TRACE_PERIOD_US); \
+				start = __rdtsc(); \
+				check += (update); \
+				total += __rdtsc() - start; \
+			} \
+			if (total < best) best = total; \
+		} \
+		(result) = (double)best / RANGE_TRACE_LENGTH; \
+	} while (0)
+
+int main(void)
+{
+	state_machine_params_t params = {0};
+	double cycles;
+	long check = 0;
+
+	make_range_trace();
+	params.signals[TIME_TO_COLLISION_SIGNAL] = INT32_MAX;
+	INITIALIZE_ENGINE();
+	BENCH(UPDATE_ENGINE(&params), cycles);
+	printf("C %.1f cycles/update (check %ld)\n", cycles, check);
+#ifdef BENCH_CPP
+	check = 0;
+	params.timestamp_us = 0;
+	initialize_cpp_machine();
+	BENCH(update_cpp_machine(&params), cycles);
+	printf("C++ %.1f cycles/update (check %ld)\n", cycles, check);
+#endif
+	return 0;
+}
@@ -0,0 +1,23 @@
+/* The backup alert machine on the C++ engine, behind C calls.
+ *
+ * Kept in its own object so its text can be compared with the C engine's.
+ * Pass -DCPP_MACHINE=ultrasound_backup::alert_machine for trees from before
+ * the C++ machine was generated.
+ */
+#include "ultrasound_backup_state_machine.hpp"
+
+#ifndef CPP_MACHINE
+#define CPP_MACHINE ultrasound_backup::machine_type
+#endif
+
+static CPP_MACHINE cpp_machine;
+
+extern "C" state_machine_state_enum_t initialize_cpp_machine(void)
+{
+	return cpp_machine.initialize();
+}
+
+extern "C" state_machine_state_enum_t update_cpp_machine(const state_machine_params_t* params)
+{
+	return cpp_machine.update(*params);
+}
@@ -0,0 +1,48 @@
+/* Calls the engine the way the tree under test declares it.
+ *
+ * The engine took its configuration and parameters by value up to the band
+ * lookup table, then by pointer, then per instance, and only has dwell
+ * timestamps since hysteresis landed. Build older trees with
+ * -DSTATE_MACHINE_API=STATE_MACHINE_API_BY_VALUE or
+ * STATE_MACHINE_API_BY_POINTER, and -DSTATE_MACHINE_NO_TIMESTAMP before
+ * hysteresis. The default is the current instance API. The configuration
+ * was my_state_machine_config until the tables were generated, pass
+ * -DENGINE_CONFIG=my_state_machine_config for those trees.
+ */
+#ifndef ENGINE_API_H
+#define ENGINE_API_H
+
+#include "ultrasound_backup_state_machine.h"
+
+#define STATE_MACHINE_API_BY_VALUE 0
+#define STATE_MACHINE_API_BY_POINTER 1
+#define STATE_MACHINE_API_INSTANCE 2
+
+#ifndef ENGINE_CONFIG
+#define ENGINE_CONFIG ultrasound_backup_config
+#endif
+
+#ifndef STATE_MACHINE_API
+#define STATE_MACHINE_API STATE_MACHINE_API_INSTANCE
+#endif
+
+#if STATE_MACHINE_API == STATE_MACHINE_API_BY_VALUE
+#define INITIALIZE_ENGINE() initialize_state_machine(ENGINE_CONFIG)
+#define UPDATE_ENGINE(params) update_state_machine(*(params))
+#elif STATE_MACHINE_API == STATE_MACHINE_API_BY_POINTER
+#define INITIALIZE_ENGINE() initialize_state_machine(&ENGINE_CONFIG)
+#define UPDATE_ENGINE(params) update_state_machine(params)
+#else
+/* Every driver includes this once, not every driver uses the instance */
+state_machine_t engine_machine;
+#define INITIALIZE_ENGINE() initialize_state_machine(&engine_machine, &ENGINE_CONFIG)
+#define UPDATE_ENGINE(params) update_state_machine(&engine_machine, params)
+#endif
+
+#ifdef STATE_MACHINE_NO_TIMESTAMP
+#define SET_ENGINE_TIMESTAMP(params, time_us) ((void)(time_us))
+#else
+#define SET_ENGINE_TIMESTAMP(params, time_us) ((params)->timestamp_us = (time_us))
+#endif
+
+#endif
@@ -0,0 +1,88 @@
+/* Checks the C and C++ engines run the backup alert machine the same.
+ *
+ * Both run the same random parameters, 50 seeds of RANDOM_PARAMS_LENGTH
+ * updates. After every update the state, the ping rate and the counts of
+ * LED writes and ping rate changes the hooks made have to match.
+ */
+#include <stdio.h>
+#include "engine_api.h"
+#include "random_params.h"
+
+/* Hook side effects counted by the stubs */
+extern int gpio_writes;
+extern int ping_rate_sets;
+extern uint32_t last_ping_rate_hz;
+extern volatile uint8_t critical_alert_flashing;
+
+state_machine_state_enum_t initialize_cpp_machine(void);
+state_machine_state_enum_t update_cpp_machine(const state_machine_params_t* params);
+
+#define EQUIVALENCE_SEEDS 50
+
+/* State and hook side effects after one update */
+typedef struct
+{
+	int32_t state;
+	int gpio_writes;
+	int ping_rate_sets;
+	uint32_t ping_rate_hz;
+	uint8_t is_flashing;
+} step_t;
+
+static state_machine_params_t params[RANDOM_PARAMS_LENGTH];
+static step_t c_steps[RANDOM_PARAMS_LENGTH + 1];
+static step_t cpp_steps[RANDOM_PARAMS_LENGTH + 1];
+
+static void record(step_t* step, int32_t state)
+{
+	step->state = state;
+	step->gpio_writes = gpio_writes;
+	step->ping_rate_sets = ping_rate_sets;
+	step->ping_rate_hz = last_ping_rate_hz;
+	step->is_flashing = critical_alert_flashing;
+}
+
+static int is_same_step(const step_t* a, const step_t* b)
+{
+	return a->state == b->state && a->gpio_writes == b->gpio_writes &&
+		a->ping_rate_sets == b->ping_rate_sets && a->ping_rate_hz == b->ping_rate_hz &&
+		a->is_flashing == b->is_flashing;
+}
+
+static void run(int is_cpp, step_t* steps)
+{
+	int i;
+
+	gpio_writes = 0;
+	ping_rate_sets = 0;
+	critical_alert_flashing = 0;
+	record(&steps[0], is_cpp ? initialize_cpp_machine() : INITIALIZE_ENGINE());
+	for (i = 0; i < RANDOM_PARAMS_LENGTH; i++)
+	{
+		int32_t state = is_cpp ? update_cpp_machine(&params[i]) : UPDATE_ENGINE(&params[i]);
+		record(&steps[i + 1], state);
+	}
+}
+
+int main(void)
+{
+	unsigned seed;
+	int i;
+
+	for (seed = 1; seed <= EQUIVALENCE_SEEDS; seed++)
+	{
+		make_random_params(seed, params, RANDOM_PARAMS_LENGTH);
+		run(0, c_steps);
+		run(1, cpp_steps);
+		for (i = 0; i <= RANDOM_PARAMS_LENGTH; i++)
+		{
+			if (!is_same_step(&c_steps[i], &cpp_steps[i]))
+			{
+				printf("C and C++ differ on seed %u at update %d\n", seed, i);
+				return 1;
+			}
+		}
+	}
+	printf("C and C++ agree on %d seeds\n", EQUIVALENCE_SEEDS);
+	return 0;
+}
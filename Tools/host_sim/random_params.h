@@ -0,0 +1,36 @@
+/* Random update parameters shared by the equivalence drivers.
+ *
+ * A walk between 0 and 500 mm in 1 mm steps of up to 40 mm, a time to collision
+ * under a second on a quarter of the samples and samples 20 to 80 ms apart,
+ * so every band edge, the critical time to collision and both dwell
+ * outcomes are hit many times per seed.
+ */
+#ifndef RANDOM_PARAMS_H
+#define RANDOM_PARAMS_H
+
+#include <stdlib.h>
+#include "ultrasound_backup_state_machine.h"
+
+#define RANDOM_PARAMS_LENGTH 20000
+
+static void make_random_params(unsigned seed, state_machine_params_t* params, int count)
+{
+	int distance_mm = 400;
+	uint64_t timestamp_us = 0;
+	int i;
+
+	srand(seed);
+	for (i = 0; i < count; i++)
+	{
+		distance_mm += rand() % 81 - 40;
+		if (distance_mm < 0) distance_mm = 0;
+		if (distance_mm > 500) distance_mm = 500;
+		params[i].signals[DISTANCE_SIGNAL] = distance_mm;
+		params[i].signals[TIME_TO_COLLISION_SIGNAL] = (rand() % 4 == 0) ? rand() % 1000 : INT32_MAX;
+		params[i].signals[VELOCITY_SIGNAL] = rand() % 100;
+		timestamp_us += 20000 + rand() % 60000;
+		params[i].timestamp_us = timestamp_us;
+	}
+}
+
+#endif
@@ -0,0 +1,36 @@
+/* Synthetic range trace shared by the host drivers.
+ *
+ * Not a recording: a seeded random walk between 0 and 500 mm in 1 mm
+ * steps of up to 30 mm, one sample per 50 ms (20 Hz). It sweeps every
+ * alert band many times and chatters at each edge, which is what the
+ * engine changes are compared on. The sequence depends on the C library's
+ * rand(), the numbers quoted in the history were taken with glibc, up to
+ * the hysteresis fixes on the earlier 10 mm walk.
+ */
+#ifndef RANGE_TRACE_H
+#define RANGE_TRACE_H
+
+#include <stdlib.h>
+
+#define RANGE_TRACE_LENGTH 20000
+#define RANGE_TRACE_SEED 1234
+#define RANGE_TRACE_PERIOD_US 50000
+
+static int range_trace_mm[RANGE_TRACE_LENGTH];
+
+static void make_range_trace(void)
+{
+	int distance_mm = 400;
+	int i;
+
+	srand(RANGE_TRACE_SEED);
+	for (i = 0; i < RANGE_TRACE_LENGTH; i++)
+	{
+		distance_mm += rand() % 61 - 30;
+		if (distance_mm < 0) distance_mm = 0;
+		if (distance_mm > 500) distance_mm = 500;
+		range_trace_mm[i] = distance_mm;
+	}
+}
+
+#endif
@@ -0,0 +1,82 @@
+#!/bin/sh
+# Builds the host drivers against a tree and runs them.
+#
+#     Tools/host_sim/run.sh [tree] [extra compiler flags]
+#
+# tree defaults to this checkout. To compare against an earlier commit, check
+# it out with 'git worktree add /tmp/before <commit>' and pass /tmp/before,
+# adding the flags engine_api.h lists for commits with an older engine API.
+set -e
+here=$(cd "$(dirname "$0")" && pwd)
+tree=${1:-$here/../..}
+[ $# -gt 0 ] && shift
+out=$(mktemp -d)
+trap 'rm -rf "$out"' EXIT
+
+# Generated tables have to match their description before they are measured
+if [ -f "$tree/Core/Src/ultrasound_backup_tables.c" ]; then
+	(cd "$tree" && python3 Tools/state_machine_compiler.py Tools/ultrasound_backup.sm \
+		--emit tables --header Core/Inc/ultrasound_backup_tables.h \
+		--source Core/Src/ultrasound_backup_tables.c \
+		--cpp Core/Inc/ultrasound_backup_state_machine.hpp --check 2>/dev/null) ||
+		{ echo "generated tables are out of date" >&2; exit 1; }
+fi
+
+# The engine is copied on its own, the stubs stand in for the HAL headers
+# and are the only headers exempt from warnings
+mkdir "$out/src" "$out/stubs"
+cp "$here"/stubs/*.h "$out/stubs/"
+for name in state_machine ultrasound_backup_state_machine ultrasound_backup_tables; do
+	for file in "$tree/Core/Inc/$name.h" "$tree/Core/Inc/$name.hpp" "$tree/Core/Src/$name.c"; do
+		[ -f "$file" ] && cp "$file" "$out/src/"
+	done
+done
+flags="-O2 -Wall -Wextra -I$out/src -isystem $out/stubs -I$here $*"
+for source in "$out"/src/*.c "$here/stubs/stubs.c"; do
+	cc $flags -c -o "$out/$(basename "$source" .c).o" "$source"
+done
+objects=$(ls "$out"/*.o)
+
+cc $flags -o "$out/trace_states" "$here/trace_states.c" $objects
+"$out/trace_states" > "$out/states.txt"
+echo "state trace: $(md5sum < "$out/states.txt" | cut -d' ' -f1)"
+
+# The batch update exists from its own commit on
+if grep -q update_state_machine_batch "$out/src/state_machine.h"; then
+	cc $flags -o "$out/batch_equivalence" "$here/batch_equivalence.c" $objects
+	"$out/batch_equivalence"
+fi
+
+# The C++ engine exists from its own commit on, it is checked and timed against the C one
+if [ -f "$out/src/state_machine.hpp" ]; then
+	c++ -std=c++17 $flags -c -o "$out/cpp_engine.o" "$here/cpp_engine.cpp"
+	cc $flags -o "$out/equivalence" "$here/equivalence.c" $objects "$out/cpp_engine.o"
+	cc $flags -DBENCH_CPP -o "$out/bench_update" "$here/bench_update.c" $objects "$out/cpp_engine.o"
+	"$out/equivalence"
+	if grep -q update_state_machine_batch "$out/src/state_machine.h"; then
+		cc $flags -o "$out/threshold_sweep" "$here/threshold_sweep.c" $objects "$out/cpp_engine.o"
+		"$out/threshold_sweep"
+	fi
+	"$out/bench_update"
+	echo "engine text: C $(size -A "$out/state_machine.o" | awk '$1 == ".text" { print $2 }') B," \
+		"C++ $(size -A "$out/cpp_engine.o" | awk '$1 ~ /^\.text/ { n += $2 } END { print n }') B"
+else
+	cc $flags -o "$out/bench_update" "$here/bench_update.c" $objects
+	"$out/bench_update"
+fi
+
+# The scheduler gets its own stand-in main.h with a cycle counter and TIM6
+if [ -f "$tree/Core/Src/scheduler.c" ]; then
+	mkdir "$out/sched" "$out/sched_stubs"
+	cp "$here"/scheduler_stubs/*.h "$out/sched_stubs/"
+	for name in scheduler timestamp activity; do
+		cp "$tree/Core/Inc/$name.h" "$out/sched/"
+	done
+	for mode in 0 1; do
+		echo "scheduler, INTERRUPT_DRIVEN_MODE $mode:"
+		cc -O2 -Wall -Wextra -DINTERRUPT_DRIVEN_MODE=$mode -I"$out/sched" -isystem "$out/sched_stubs" \
+			-o "$out/scheduler_check" \
+			"$here/scheduler_check.c" "$tree/Core/Src/scheduler.c"
+		"$out/scheduler_check"
+	done
+fi
@@ -0,0 +1,358 @@
+/* Checks the scheduler's releases, deadlines and sleep on a simulated clock.
+ *
+ * Tasks spend time on the cycle counter, sleep spends it on TIM6, so the
+ * timestamp only stays right if the scheduler catches it up after sleep.
+ * The loop is run_scheduler() bounded to a simulated time. Built with
+ * INTERRUPT_DRIVEN_MODE, it is the TIM6 interrupt running
+ * dispatch_scheduler() with the core sleeping in between, and every other
+ * sleep is cut short by another interrupt that has to see a caught up
+ * timestamp as well.
+ *
+ * - An event task without a deadline of its own is refused.
+ * - A task overrunning its deadline misses on every run, and a short task
+ *   stuck behind it misses the releases it could not take.
+ * - An event task runs once per signal and meets its deadline.
+ * - A periodic task signalled by another task still runs on time in every
+ *   one of its periods, and once more per signal.
+ */
+#include <stdio.h>
+#include "main.h"
+#include "scheduler.h"
+#include "timestamp.h"
+#include "activity.h"
+
+#define CORE_CLOCK_HZ 80000000
+#define CYCLES_PER_US (CORE_CLOCK_HZ / 1000000)
+#define RUN_US 1000000
+
+/* A run counts as on its period when it starts this close to a release */
+#define ON_PERIOD_SLACK_US 200
+
+DWT_Type host_dwt;
+TIM_TypeDef host_tim6;
+uint32_t SystemCoreClock = CORE_CLOCK_HZ;
+volatile uint32_t uwTick;
+uint64_t host_slept_us;
+uint8_t host_tim6_pending;
+
+/* Time the cycle counter did not count */
+static uint64_t advanced_us;
+static int error_handler_calls;
+
+/* Nesting of running code, the core sleeps at 0 */
+static int activity_depth;
+
+/* Wakes that saw a timestamp off the real time */
+static uint32_t wakes_off_time;
+
+/* The scheduler's private functions, non-static like the rest of Core */
+uint8_t find_ready_task(uint64_t now_us, uint64_t* next_release_us);
+void run_task(uint8_t task, uint64_t now_us);
+void sleep_until_release(uint64_t sleep_us);
+
+void advance_timestamp(uint32_t elapsed_us)
+{
+	advanced_us += elapsed_us;
+}
+
+void enter_activity()
+{
+	if (activity_depth++ == 0) activity_wake_callback();
+}
+
+void exit_activity()
+{
+	activity_depth--;
+}
+
+#if !INTERRUPT_DRIVEN_MODE
+/* Only the interrupt-driven scheduler overrides it */
+void activity_wake_callback()
+{
+}
+
+uint32_t HAL_GetTick(void)
+{
+	return uwTick;
+}
+#endif
+
+void Error_Handler(void)
+{
+	error_handler_calls++;
+}
+
+/* Counts TIM6 on by time spent awake or asleep, stopping at the update
+ * like one-pulse mode */
+static void count_timer(uint32_t time_us)
+{
+	if (!(host_tim6.CR1 & TIM_CR1_CEN)) return;
+
+	host_tim6.CNT += time_us;
+	if (host_tim6.CNT > host_tim6.ARR)
+	{
+		host_tim6.CNT = 0;
+		host_tim6.SR |= TIM_FLAG_UPDATE;
+		host_tim6.CR1 &= ~TIM_CR1_CEN;
+	}
+}
+
+/* Spends time running on the core */
+static void busy(uint32_t time_us)
+{
+	host_dwt.CYCCNT += time_us * CYCLES_PER_US;
+	count_timer(time_us);
+}
+
+/* Every read costs a microsecond, so code waiting on the clock gets there */
+uint64_t get_timestamp_us()
+{
+	busy(1);
+	return host_dwt.CYCCNT / CYCLES_PER_US + advanced_us;
+}
+
+
+#if INTERRUPT_DRIVEN_MODE
+/* Time awake and asleep, which the timestamp has to follow */
+static uint64_t get_real_time_us(void)
+{
+	return host_dwt.CYCCNT / CYCLES_PER_US + host_slept_us;
+}
+
+/* Marks a wake, where the timestamp has to be caught up before anything
+ * reads it */
+static void wake(void)
+{
+	enter_activity();
+	if (get_timestamp_us() != get_real_time_us()) wakes_off_time++;
+}
+
+/* Sleeps until TIM6 fires, every other time woken halfway by another
+ * interrupt */
+static void sleep(void)
+{
+	static uint32_t sleeps;
+	uint32_t timer_us = host_tim6.ARR + 1;
+
+	uint32_t sleep_us = timer_us - host_tim6.CNT;
+
+	if (sleeps++ % 2 == 0 && sleep_us > 1)
+	{
+		host_slept_us += sleep_us / 2;
+		count_timer(sleep_us / 2);
+		wake();
+		busy(5);
+		exit_activity();
+		return;
+	}
+	host_slept_us += sleep_us;
+	count_timer(sleep_us);
+}
+
+static void run_until(uint64_t end_us)
+{
+	start_scheduler();
+	exit_activity();
+	/* Nothing reads the timestamp in sleep, so the end goes by the real time */
+	while (get_real_time_us() < end_us)
+	{
+		if (host_tim6.SR & TIM_FLAG_UPDATE)
+		{
+			/* Woken by TIM6 */
+			wake();
+			dispatch_scheduler();
+			exit_activity();
+		}
+		else if (host_tim6_pending)
+		{
+			/* Pended by a signal or start_scheduler() */
+			host_tim6_pending = 0;
+			enter_activity();
+			dispatch_scheduler();
+			exit_activity();
+		}
+		else
+		{
+			sleep();
+		}
+	}
+	enter_activity();
+}
+#else
+static void run_until(uint64_t end_us)
+{
+	uint64_t now_us;
+	uint64_t next_release_us;
+	uint8_t task;
+
+	while ((now_us = get_timestamp_us()) < end_us)
+	{
+		task = find_ready_task(now_us, &next_release_us);
+		if (task != SCHEDULER_NO_TASK)
+		{
+			run_task(task, now_us);
+		}
+		else if (next_release_us - now_us >= SCHEDULER_MIN_SLEEP_US)
+		{
+			sleep_until_release(next_release_us - now_us);
+		}
+		else
+		{
+			busy((uint32_t)(next_release_us - now_us));
+		}
+	}
+}
+#endif
+
+static void reset(void)
+{
+	host_dwt.CYCCNT = 0;
+	host_slept_us = 0;
+	host_tim6.CR1 = 0;
+	host_tim6.CNT = 0;
+	host_tim6.SR = 0;
+	host_tim6_pending = 0;
+	advanced_us = 0;
+	activity_depth = 1;
+	wakes_off_time = 0;
+	initialize_scheduler();
+}
+
+static int check(int is_ok, const char* what)
+{
+	if (!is_ok) printf("scheduler: %s\n", what);
+	return is_ok;
+}
+
+/* Overrun scenario */
+static uint8_t event_task;
+static uint32_t fast_runs;
+static uint32_t signals;
+
+static void fast_func(void)
+{
+	busy(100);
+	if (++fast_runs % 10 == 0)
+	{
+		signals++;
+		signal_scheduler_task(event_task);
+	}
+}
+
+static void slow_func(void)
+{
+	busy(30000);
+}
+
+static void event_func(void)
+{
+	busy(10);
+}
+
+static int check_overrun(void)
+{
+	scheduler_task_stats_t fast, slow, event;
+	uint64_t awake_us;
+	int is_ok = 1;
+
+	reset();
+	error_handler_calls = 0;
+	is_ok &= check(add_scheduler_task(event_func, SCHEDULER_EVENT_TASK, SCHEDULER_PERIOD_DEADLINE, 0)
+		== SCHEDULER_NO_TASK && error_handler_calls == 1, "event task without a deadline accepted");
+
+	fast_runs = 0;
+	signals = 0;
+	add_scheduler_task(fast_func, 1000, SCHEDULER_PERIOD_DEADLINE, 0);
+	add_scheduler_task(slow_func, 50000, 20000, 1);
+	event_task = add_scheduler_task(event_func, SCHEDULER_EVENT_TASK, 500, 0);
+	run_until(RUN_US - 1);
+
+	get_scheduler_task_stats(0, &fast);
+	get_scheduler_task_stats(1, &slow);
+	get_scheduler_task_stats(event_task, &event);
+	printf("overrun: fast %lu runs %lu misses, slow %lu runs %lu misses, event %lu runs %lu misses\n",
+		(unsigned long)fast.runs, (unsigned long)fast.deadline_misses,
+		(unsigned long)slow.runs, (unsigned long)slow.deadline_misses,
+		(unsigned long)event.runs, (unsigned long)event.deadline_misses);
+
+	is_ok &= check(slow.runs == RUN_US / 50000 - 1 && slow.deadline_misses == slow.runs,
+		"overrunning task does not miss every run");
+	is_ok &= check(fast.deadline_misses > 0 && fast.runs + fast.deadline_misses >= RUN_US / 1000 - 1,
+		"blocked releases are not counted as misses");
+	is_ok &= check(event.runs == signals && event.deadline_misses == 0, "event task runs differ from its signals");
+
+	/* The timestamp is caught up on everything the cycle counter missed */
+	awake_us = host_dwt.CYCCNT / CYCLES_PER_US;
+	is_ok &= check(host_slept_us > 0 && advanced_us == host_slept_us && wakes_off_time == 0,
+		"timestamp not caught up after sleep");
+	printf("overrun: awake %lu us, slept %lu us\n", (unsigned long)awake_us, (unsigned long)host_slept_us);
+	return is_ok;
+}
+
+/* Phase scenario */
+#define PERIODIC_US 10000
+#define SIGNALLER_US 7000
+
+static uint8_t periodic_task;
+static uint32_t periodic_runs;
+static uint32_t released_periods;
+static uint64_t last_period;
+static uint32_t phase_signals;
+
+static void periodic_func(void)
+{
+	uint64_t now_us = get_timestamp_us();
+
+	periodic_runs++;
+	if (now_us % PERIODIC_US < ON_PERIOD_SLACK_US && now_us / PERIODIC_US != last_period)
+	{
+		released_periods++;
+		last_period = now_us / PERIODIC_US;
+	}
+	busy(100);
+}
+
+/* Runs after the periodic task when both are released at once, so every
+ * signal comes after a run and adds one */
+static void signaller_func(void)
+{
+	phase_signals++;
+	signal_scheduler_task(periodic_task);
+	busy(20);
+}
+
+static int check_phase(void)
+{
+	scheduler_task_stats_t periodic;
+	int is_ok = 1;
+
+	reset();
+	periodic_runs = 0;
+	released_periods = 0;
+	last_period = 0;
+	phase_signals = 0;
+	periodic_task = add_scheduler_task(periodic_func, PERIODIC_US, SCHEDULER_PERIOD_DEADLINE, 0);
+	add_scheduler_task(signaller_func, SIGNALLER_US, SCHEDULER_PERIOD_DEADLINE, 1);
+	run_until(RUN_US - 1);
+
+	get_scheduler_task_stats(periodic_task, &periodic);
+	printf("phase: periodic %lu runs, %lu periods run on time, %lu signals, %lu misses\n",
+		(unsigned long)periodic_runs, (unsigned long)released_periods,
+		(unsigned long)phase_signals, (unsigned long)periodic.deadline_misses);
+
+	is_ok &= check(released_periods == RUN_US / PERIODIC_US - 1, "signals shift the periodic releases");
+	is_ok &= check(periodic_runs == released_periods + phase_signals, "signals do not add one run each");
+	is_ok &= check(periodic.deadline_misses == 0, "signalled periodic task misses");
+	return is_ok;
+}
+
+int main(void)
+{
+	int is_ok = 1;
+
+	is_ok &= check_overrun();
+	is_ok &= check_phase();
+	if (!is_ok) return 1;
+	printf("scheduler checks pass\n");
+	return 0;
+}
@@ -0,0 +1,87 @@
+/* Host stand-in for Core/Inc/main.h: just enough HAL for the scheduler to
+ * build with the host compiler. Task time runs on the cycle counter, sleep
+ * runs on TIM6, like on the target where the cycle counter stops in sleep. */
+#ifndef MAIN_H
+#define MAIN_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* The harness builds once per mode */
+#ifndef INTERRUPT_DRIVEN_MODE
+#define INTERRUPT_DRIVEN_MODE 0
+#endif
+#define TASK_IRQ_PRIORITY 8
+
+typedef struct { volatile uint32_t CYCCNT; } DWT_Type;
+typedef struct { uint32_t CR1; uint32_t ARR; uint32_t CNT; uint32_t SR; } TIM_TypeDef;
+typedef struct
+{
+	TIM_TypeDef* Instance;
+	struct
+	{
+		uint32_t Prescaler;
+		uint32_t CounterMode;
+		uint32_t Period;
+		uint32_t ClockDivision;
+		uint32_t AutoReloadPreload;
+	} Init;
+} TIM_HandleTypeDef;
+typedef enum { HAL_OK = 0, HAL_ERROR } HAL_StatusTypeDef;
+
+extern DWT_Type host_dwt;
+extern TIM_TypeDef host_tim6;
+extern uint32_t SystemCoreClock;
+extern volatile uint32_t uwTick;
+
+/* Time in us the core slept */
+extern uint64_t host_slept_us;
+/* Set while the TIM6 interrupt is pending */
+extern uint8_t host_tim6_pending;
+
+#define DWT (&host_dwt)
+#define TIM6 (&host_tim6)
+#define TIM6_DAC_IRQn 54
+#define TIM_CR1_CEN 0x1
+#define TIM_CR1_OPM 0x8
+#define TIM_COUNTERMODE_UP 0
+#define TIM_CLOCKDIVISION_DIV1 0
+#define TIM_AUTORELOAD_PRELOAD_DISABLE 0
+#define TIM_FLAG_UPDATE 0x1
+#define TIM_IT_UPDATE 0x1
+
+#define __HAL_RCC_TIM6_CLK_ENABLE()
+#define __HAL_TIM_CLEAR_FLAG(h, f) ((h)->Instance->SR &= ~(f))
+#define __HAL_TIM_GET_FLAG(h, f) (((h)->Instance->SR & (f)) != 0)
+#define __HAL_TIM_ENABLE_IT(h, i)
+#define __HAL_TIM_SET_COUNTER(h, v) ((h)->Instance->CNT = (v))
+#define __HAL_TIM_GET_COUNTER(h) ((h)->Instance->CNT)
+#define __HAL_TIM_SET_AUTORELOAD(h, v) ((h)->Instance->ARR = (v))
+#define __HAL_TIM_GET_AUTORELOAD(h) ((h)->Instance->ARR)
+#define __HAL_TIM_ENABLE(h) ((h)->Instance->CR1 |= TIM_CR1_CEN)
+#define __HAL_TIM_DISABLE(h) ((h)->Instance->CR1 &= ~TIM_CR1_CEN)
+#define HAL_NVIC_SetPriority(irq, priority, sub)
+#define HAL_NVIC_EnableIRQ(irq)
+#define HAL_NVIC_SetPendingIRQ(irq) (host_tim6_pending = 1)
+#define HAL_NVIC_ClearPendingIRQ(irq)
+#define HAL_SuspendTick()
+#define HAL_ResumeTick()
+
+static inline HAL_StatusTypeDef HAL_TIM_Base_Init(TIM_HandleTypeDef* htim) { (void)htim; return HAL_OK; }
+static inline uint32_t __get_PRIMASK(void) { return 0; }
+static inline void __set_PRIMASK(uint32_t primask) { (void)primask; }
+static inline void __disable_irq(void) {}
+static inline void __enable_irq(void) {}
+static inline void __DSB(void) {}
+
+/* Nothing else wakes the core, so every sleep lasts until TIM6 expires */
+static inline void __WFI(void)
+{
+	host_slept_us += host_tim6.ARR + 1;
+	host_tim6.SR |= TIM_FLAG_UPDATE;
+}
+
+uint32_t HAL_GetTick(void);
+void Error_Handler(void);
+
+#endif
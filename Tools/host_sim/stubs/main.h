@@ -0,0 +1,28 @@
+/* Host stand-in for Core/Inc/main.h: just enough HAL for the state machine
+ * engine and the backup alert tables to build with the host compiler. */
+#ifndef MAIN_H
+#define MAIN_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef enum { GPIO_PIN_RESET = 0, GPIO_PIN_SET } GPIO_PinState;
+typedef int GPIO_TypeDef;
+
+extern GPIO_TypeDef host_gpio_b, host_gpio_e;
+#define RED_LED_GPIO_Port (&host_gpio_b)
+#define RED_LED_Pin 2
+#define GREEN_LED_GPIO_Port (&host_gpio_e)
+#define GREEN_LED_Pin 8
+
+void HAL_GPIO_WritePin(GPIO_TypeDef* port, uint16_t pin, GPIO_PinState state);
+void HAL_GPIO_TogglePin(GPIO_TypeDef* port, uint16_t pin);
+uint32_t HAL_GetTick(void);
+void Error_Handler(void);
+
+static inline uint32_t __get_PRIMASK(void) { return 0; }
+static inline void __set_PRIMASK(uint32_t primask) { (void)primask; }
+static inline void __disable_irq(void) {}
+static inline void __enable_irq(void) {}
+
+#endif
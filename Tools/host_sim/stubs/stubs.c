@@ -0,0 +1,35 @@
+#include "main.h"
+#include "ultrasound.h"
+
+GPIO_TypeDef host_gpio_b, host_gpio_e;
+
+/* Counted so drivers can compare the hooks two engines ran */
+int gpio_writes = 0;
+int ping_rate_sets = 0;
+uint32_t last_ping_rate_hz = 0;
+
+void HAL_GPIO_WritePin(GPIO_TypeDef* port, uint16_t pin, GPIO_PinState state)
+{
+	(void)port; (void)pin; (void)state;
+	gpio_writes++;
+}
+
+void HAL_GPIO_TogglePin(GPIO_TypeDef* port, uint16_t pin)
+{
+	(void)port; (void)pin;
+}
+
+uint32_t HAL_GetTick(void)
+{
+	return 0;
+}
+
+void Error_Handler(void)
+{
+}
+
+void set_ultrasound_ping_rate(uint32_t rate_hz)
+{
+	ping_rate_sets++;
+	last_ping_rate_hz = rate_hz;
+}
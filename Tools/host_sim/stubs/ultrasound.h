@@ -0,0 +1,4 @@
+/* Host stand-in for Core/Inc/ultrasound.h, the alert hooks set the ping rate */
+#include "main.h"
+
+void set_ultrasound_ping_rate(uint32_t rate_hz);
@@ -0,0 +1,226 @@
+/* Checks the backup alert machine right at its band edges.
+ *
+ * The random walks rarely land exactly on a threshold, so every threshold
+ * is probed at -1, 0 and +1, and at the same offsets around the threshold
+ * moved by the hysteresis either way. Every ordered pair of probes runs as
+ * far, first probe, second probe, first probe again, each held past the
+ * clearing dwell, with the second probe also run at times to collision
+ * around CRITICAL_ALERT_TTC_MS.
+ *
+ * Three engines have to agree on the state and the hook side effects after
+ * every update: the C engine through its band lookup table, the C engine
+ * checking the transitions in turn, and the C++ engine. The whole sweep
+ * run as one batch has to take the same transitions and end the same.
+ * Coming down from far away, each probe also has to land in the band its
+ * distance is in, an edge itself belonging to the band below it.
+ */
+#include <stdio.h>
+#include <string.h>
+#include "engine_api.h"
+
+/* Hook side effects counted by the stubs */
+extern int gpio_writes;
+extern int ping_rate_sets;
+extern uint32_t last_ping_rate_hz;
+extern volatile uint8_t critical_alert_flashing;
+
+state_machine_state_enum_t initialize_cpp_machine(void);
+state_machine_state_enum_t update_cpp_machine(const state_machine_params_t* params);
+
+#define FAR_MM 400
+#define HOLD_SAMPLES 10
+#define SAMPLE_PERIOD_US 50000
+#define SEGMENTS 4
+#define SWEEP_LENGTH (SEGMENTS * HOLD_SAMPLES)
+
+#define THRESHOLD_COUNT 4
+#define PROBES_PER_THRESHOLD 9
+#define PROBE_COUNT (THRESHOLD_COUNT * PROBES_PER_THRESHOLD)
+#define TTC_COUNT 4
+
+enum { ENGINE_LUT, ENGINE_SCAN, ENGINE_CPP, ENGINE_COUNT };
+
+/* State and hook side effects after one update */
+typedef struct
+{
+	int32_t state;
+	int gpio_writes;
+	int ping_rate_sets;
+	uint32_t ping_rate_hz;
+	uint8_t is_flashing;
+} step_t;
+
+static const int32_t thresholds_mm[THRESHOLD_COUNT] =
+	{ LOW_ALERT_MM, MEDIUM_ALERT_MM, HIGH_ALERT_MM, CRITICAL_ALERT_MM };
+static const int32_t ttcs_ms[TTC_COUNT] =
+	{ INT32_MAX, CRITICAL_ALERT_TTC_MS + 1, CRITICAL_ALERT_TTC_MS, CRITICAL_ALERT_TTC_MS - 1 };
+
+static int32_t probes_mm[PROBE_COUNT];
+static state_machine_params_t params[SWEEP_LENGTH];
+static step_t steps[ENGINE_COUNT][SWEEP_LENGTH + 1];
+static state_machine_event_t batch_events[SWEEP_LENGTH];
+
+/* The same tables with the band lookup table left out */
+static state_machine_config_t scan_config;
+static state_machine_t scan_machine;
+
+static void record(step_t* step, int32_t state)
+{
+	step->state = state;
+	step->gpio_writes = gpio_writes;
+	step->ping_rate_sets = ping_rate_sets;
+	step->ping_rate_hz = last_ping_rate_hz;
+	step->is_flashing = critical_alert_flashing;
+}
+
+static int is_same_step(const step_t* a, const step_t* b)
+{
+	return a->state == b->state && a->gpio_writes == b->gpio_writes &&
+		a->ping_rate_sets == b->ping_rate_sets && a->ping_rate_hz == b->ping_rate_hz &&
+		a->is_flashing == b->is_flashing;
+}
+
+static void run(int engine, step_t* engine_steps)
+{
+	int32_t state;
+	int i;
+
+	gpio_writes = 0;
+	ping_rate_sets = 0;
+	critical_alert_flashing = 0;
+	if (engine == ENGINE_LUT) state = INITIALIZE_ENGINE();
+	else if (engine == ENGINE_SCAN) state = initialize_state_machine(&scan_machine, &scan_config);
+	else state = initialize_cpp_machine();
+	record(&engine_steps[0], state);
+
+	for (i = 0; i < SWEEP_LENGTH; i++)
+	{
+		if (engine == ENGINE_LUT) state = UPDATE_ENGINE(&params[i]);
+		else if (engine == ENGINE_SCAN) state = update_state_machine(&scan_machine, &params[i]);
+		else state = update_cpp_machine(&params[i]);
+		record(&engine_steps[i + 1], state);
+	}
+}
+
+/* Runs the sweep as one batch and replays its events against the single
+ * updates */
+static int is_batch_same(const step_t* single_steps)
+{
+	state_machine_t machine = {0};
+	step_t batch_step;
+	int32_t state;
+	uint16_t event_count;
+	uint16_t event = 0;
+	int i;
+
+	gpio_writes = 0;
+	ping_rate_sets = 0;
+	critical_alert_flashing = 0;
+	state = initialize_state_machine(&machine, &ENGINE_CONFIG);
+	event_count = update_state_machine_batch(&machine, params, SWEEP_LENGTH,
+		STATE_MACHINE_ACTIONS_IMMEDIATE, batch_events, SWEEP_LENGTH);
+	record(&batch_step, machine.current_state->state);
+	if (!is_same_step(&batch_step, &single_steps[SWEEP_LENGTH])) return 0;
+
+	for (i = 0; i < SWEEP_LENGTH; i++)
+	{
+		while (event < event_count && batch_events[event].sample == i) state = batch_events[event++].to;
+		if (state != single_steps[i + 1].state) return 0;
+	}
+	return event == event_count;
+}
+
+/* The band a distance falls in coming down from far away */
+static int32_t get_band(int32_t distance_mm)
+{
+	if (distance_mm <= CRITICAL_ALERT_MM) return CRITICAL_ALERT;
+	if (distance_mm <= HIGH_ALERT_MM) return HIGH_ALERT;
+	if (distance_mm <= MEDIUM_ALERT_MM) return MEDIUM_ALERT;
+	if (distance_mm <= LOW_ALERT_MM) return LOW_ALERT;
+	return NO_ALERT;
+}
+
+static void make_sweep(int32_t first_mm, int32_t second_mm, int32_t ttc_ms)
+{
+	const int32_t segments_mm[SEGMENTS] = { FAR_MM, first_mm, second_mm, first_mm };
+	int segment;
+	int i;
+
+	memset(params, 0, sizeof(params));
+	for (segment = 0; segment < SEGMENTS; segment++)
+	{
+		for (i = segment * HOLD_SAMPLES; i < (segment + 1) * HOLD_SAMPLES; i++)
+		{
+			params[i].signals[DISTANCE_SIGNAL] = segments_mm[segment];
+			params[i].signals[TIME_TO_COLLISION_SIGNAL] = (segment == 2) ? ttc_ms : INT32_MAX;
+			params[i].timestamp_us = (uint64_t)(i + 1) * SAMPLE_PERIOD_US;
+		}
+	}
+}
+
+int main(void)
+{
+	const int32_t offsets_mm[3] = { -1, 0, 1 };
+	const int32_t shifts_mm[3] = { -HYSTERESIS, 0, HYSTERESIS };
+	int sweeps = 0;
+	int threshold;
+	int shift;
+	int offset;
+	int first;
+	int second;
+	int ttc;
+	int engine;
+	int i;
+
+	scan_config = ENGINE_CONFIG;
+	scan_config.band_lut = NULL;
+	for (threshold = 0; threshold < THRESHOLD_COUNT; threshold++)
+	{
+		for (shift = 0; shift < 3; shift++)
+		{
+			for (offset = 0; offset < 3; offset++)
+			{
+				probes_mm[(threshold * 3 + shift) * 3 + offset] =
+					thresholds_mm[threshold] + shifts_mm[shift] + offsets_mm[offset];
+			}
+		}
+	}
+
+	for (first = 0; first < PROBE_COUNT; first++)
+	{
+		for (second = 0; second < PROBE_COUNT; second++)
+		{
+			for (ttc = 0; ttc < TTC_COUNT; ttc++)
+			{
+				make_sweep(probes_mm[first], probes_mm[second], ttcs_ms[ttc]);
+				for (engine = 0; engine < ENGINE_COUNT; engine++) run(engine, steps[engine]);
+
+				for (i = 0; i <= SWEEP_LENGTH; i++)
+				{
+					if (!is_same_step(&steps[ENGINE_LUT][i], &steps[ENGINE_SCAN][i]) ||
+							!is_same_step(&steps[ENGINE_LUT][i], &steps[ENGINE_CPP][i]))
+					{
+						printf("sweep %d -> %d mm at %d ms: engines differ at update %d\n",
+							(int)probes_mm[first], (int)probes_mm[second], (int)ttcs_ms[ttc], i);
+						return 1;
+					}
+				}
+				if (!is_batch_same(steps[ENGINE_LUT]))
+				{
+					printf("sweep %d -> %d mm at %d ms: batch differs\n",
+						(int)probes_mm[first], (int)probes_mm[second], (int)ttcs_ms[ttc]);
+					return 1;
+				}
+				if (steps[ENGINE_LUT][2 * HOLD_SAMPLES].state != get_band(probes_mm[first]))
+				{
+					printf("sweep %d mm: state %d instead of %d\n", (int)probes_mm[first],
+						(int)steps[ENGINE_LUT][2 * HOLD_SAMPLES].state, (int)get_band(probes_mm[first]));
+					return 1;
+				}
+				sweeps++;
+			}
+		}
+	}
+	printf("lookup table, scan, C++ and batch agree on %d edge sweeps\n", sweeps);
+	return 0;
+}
@@ -0,0 +1,32 @@
+/* Runs the backup alert machine over the range trace.
+ *
+ * Prints the state after every sample, then the number of transitions on
+ * stderr. See engine_api.h for building it against older trees.
+ */
+#include <stdio.h>
+#include "engine_api.h"
+#include "range_trace.h"
+
+int main(void)
+{
+	state_machine_params_t params = {0};
+	int state;
+	int previous;
+	int transitions = 0;
+	int i;
+
+	make_range_trace();
+	params.signals[TIME_TO_COLLISION_SIGNAL] = INT32_MAX;
+	previous = INITIALIZE_ENGINE();
+	for (i = 0; i < RANGE_TRACE_LENGTH; i++)
+	{
+		params.signals[DISTANCE_SIGNAL] = range_trace_mm[i];
+		SET_ENGINE_TIMESTAMP(&params, (uint64_t)i * RANGE_TRACE_PERIOD_US);
+		state = UPDATE_ENGINE(&params);
+		if (state != previous) transitions++;
+		previous = state;
+		printf("%d\n", state);
+	}
+	fprintf(stderr, "transitions: %d\n", transitions);
+	return 0;
+}
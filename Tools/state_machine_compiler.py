@@ -0,0 +1,841 @@
+#!/usr/bin/env python3
+"""Compiles a state machine description for Core/Src/state_machine.c.
+
+Reads a machine description, checks it and writes a header declaring the
+machine and a source with its const state tables for the engine. With
+--emit switch, the source also gets a dispatch function that checks every
+guard inline in a switch on the state, set as the configuration's dispatch.
+With --cpp, the same machine is written as a type for state_machine.hpp.
+--check compares the outputs with the files already there instead of
+writing them, so copies in the tree cannot drift from their description.
+
+The description is line based, '#' starts a comment:
+
+    machine <name>
+    signals <SIGNAL> ...
+    define <NAME> <number>
+    hysteresis <value>
+    state <STATE> [parent=<STATE>] [enter=<func>] [exit=<func>] [tick=<func>]
+      -> <STATE> when <guard> [and|or <guard>] [hysteresis=<value>]
+                  [dwell=<n>samples|<n>us|<n>ms|<NAME>] [do=<func>]
+
+A guard is '<SIGNAL> <op> <value>' with op one of == != < <= > >=. The
+first state is the initial one. Transitions are checked in the order they
+are listed, those of the state itself before those of its parents. A
+transition without hysteresis= uses the machine's, hysteresis=0 turns it
+off for that transition alone.
+
+A value is a number or a define. Defines are written to the header and the
+tables refer to them by name. A define given as a dwell takes its unit from
+the end of its name, _SAMPLES, _US or _MS.
+
+Checks made:
+    reachability: every state can be reached from the initial state.
+    determinism: transitions of a state that can hold at once are reported,
+        the first listed wins. One that can never fire is an error.
+    hysteresis: both directions across a band share the edge and the
+        hysteresis, and the hysteresis is narrower than the band it enters.
+
+Also reports how many transitions and guards one update evaluates at worst.
+
+Usage:
+    state_machine_compiler.py machine.sm [--emit tables|switch]
+        [--header out.h --source out.c [--cpp out.hpp]] [--check]
+"""
+
+import argparse
+import re
+import sys
+
+INT32_MIN = -(1 << 31)
+INT32_MAX = (1 << 31) - 1
+
+# Engine limits from Core/Inc/state_machine.h
+MAX_STATES = 16
+MAX_DEPTH = 4
+LUT_MAX_STATES = 6
+LUT_MAX_BANDS = 24
+
+OPERATORS = {
+    "==": "EQUAL",
+    "<": "LESS_THAN",
+    ">": "GREATER_THAN",
+    "<=": "LT_EQUALS",
+    ">=": "GT_EQUALS",
+    "!=": "NOT_EQUALS",
+}
+
+THRESHOLD_OPERATORS = ("<", "<=", ">", ">=")
+
+# Bytes of one transition and of a state header on the target
+TRANSITION_BYTES = 36
+STATE_BYTES = 20
+
+OPTION = re.compile(r"^(parent|enter|exit|tick|hysteresis|dwell|do)=(.+)$")
+DWELL = re.compile(r"^(\d+)(samples|us|ms)$")
+NAME = re.compile(r"^[A-Z_][A-Z0-9_]*$")
+
+# Units a named dwell takes from the end of its name
+DWELL_UNITS = (("_SAMPLES", "samples"), ("_US", "us"), ("_MS", "ms"))
+
+
+class DescriptionError(Exception):
+    """An error at a line of the description."""
+
+    def __init__(self, line, message):
+        super().__init__("line %d: %s" % (line, message))
+
+
+class Number(int):
+    """A value of the description, written in C as it was given."""
+
+    def __new__(cls, value, text=None):
+        number = super().__new__(cls, value)
+        number.text = str(value) if text is None else text
+        return number
+
+
+class Guard:
+    """Compares one signal against a threshold."""
+
+    def __init__(self, signal, op, threshold):
+        self.signal = signal
+        self.op = op
+        self.threshold = threshold
+
+    def intervals(self):
+        """Returns the signal ranges in which the guard holds."""
+        t = self.threshold
+        return {
+            "==": [(t, t)],
+            "!=": [(INT32_MIN, t - 1), (t + 1, INT32_MAX)],
+            "<": [(INT32_MIN, t - 1)],
+            "<=": [(INT32_MIN, t)],
+            ">": [(t + 1, INT32_MAX)],
+            ">=": [(t, INT32_MAX)],
+        }[self.op]
+
+    def __str__(self):
+        return "%s %s %d" % (self.signal, self.op, self.threshold)
+
+
+class Transition:
+    """A transition as listed under a state."""
+
+    def __init__(self, line, source, target, guards, combination):
+        self.line = line
+        self.source = source
+        self.target = target
+        self.guards = guards
+        self.combination = combination
+        self.hysteresis = None
+        self.dwell = None
+        self.func = None
+
+    def boxes(self):
+        """Returns the condition as a union of boxes, one range per signal."""
+        first = [{self.guards[0].signal: i} for i in self.guards[0].intervals()]
+        if self.combination == "single":
+            return first
+        second = [{self.guards[1].signal: i} for i in self.guards[1].intervals()]
+        if self.combination == "or":
+            return first + second
+        return [b for b in (intersect(a, b) for a in first for b in second) if b is not None]
+
+    def __str__(self):
+        joiner = " %s " % self.combination
+        return "%s -> %s when %s" % (self.source, self.target,
+                                    joiner.join(str(g) for g in self.guards))
+
+
+class State:
+    """A state with its hooks and own transitions."""
+
+    def __init__(self, line, name, index):
+        self.line = line
+        self.name = name
+        self.index = index
+        self.parent = None
+        self.enter = None
+        self.exit = None
+        self.tick = None
+        self.transitions = []
+
+    @property
+    def variable(self):
+        return "%s_state" % self.name.lower()
+
+
+class Machine:
+    """A parsed machine description."""
+
+    def __init__(self):
+        self.name = None
+        self.signals = []
+        self.defines = {}
+        self.hysteresis = Number(0)
+        self.states = []
+
+    def state(self, name):
+        for state in self.states:
+            if state.name == name:
+                return state
+        return None
+
+    def chain(self, state):
+        """Returns the state and its ancestors, innermost first."""
+        chain = [state]
+        while chain[-1].parent is not None:
+            chain.append(self.state(chain[-1].parent))
+        return chain
+
+    def transitions(self, state):
+        """Returns every transition a state checks, in order."""
+        return [t for s in self.chain(state) for t in s.transitions]
+
+    def hysteresis_of(self, transition):
+        if transition.hysteresis is None:
+            return self.hysteresis
+        return transition.hysteresis
+
+    @property
+    def is_hierarchical(self):
+        return any(s.parent is not None for s in self.states)
+
+
+def intersect(a, b):
+    """Intersects two boxes, None if they do not overlap."""
+    box = dict(a)
+    for signal, (lo, hi) in b.items():
+        if signal in box:
+            lo = max(lo, box[signal][0])
+            hi = min(hi, box[signal][1])
+            if lo > hi:
+                return None
+        box[signal] = (lo, hi)
+    return box
+
+
+def contains(outer, inner):
+    """Checks if a box lies completely within another."""
+    for signal, (lo, hi) in outer.items():
+        inner_lo, inner_hi = inner.get(signal, (INT32_MIN, INT32_MAX))
+        if inner_lo < lo or inner_hi > hi:
+            return False
+    return True
+
+
+def parse_int(line, text):
+    try:
+        return int(text, 0)
+    except ValueError:
+        raise DescriptionError(line, "expected a number, got '%s'" % text)
+
+
+def parse_value(line, machine, text):
+    """Reads a number or the name of a define."""
+    if text in machine.defines:
+        return Number(machine.defines[text][0], text)
+    return Number(parse_int(line, text))
+
+
+def parse_dwell(line, machine, text):
+    """Reads a dwell as <n>samples, <n>us, <n>ms or a define named for its unit."""
+    match = DWELL.match(text)
+    if match is not None:
+        count, unit = int(match.group(1)), match.group(2)
+        count = Number(count)
+    elif text in machine.defines:
+        unit = next((u for suffix, u in DWELL_UNITS if text.endswith(suffix)), None)
+        if unit is None:
+            raise DescriptionError(line, "a dwell define ends in _SAMPLES, _US or _MS")
+        count = Number(machine.defines[text][0], text)
+    else:
+        raise DescriptionError(line, "a dwell is <n>samples, <n>us, <n>ms or a define")
+    if unit == "ms":
+        return "us", Number(count * 1000, "%s * 1000" % count.text)
+    return unit, count
+
+
+def parse_guard(line, machine, tokens):
+    if len(tokens) != 3:
+        raise DescriptionError(line, "a guard is '<signal> <op> <value>'")
+    signal, op, value = tokens
+    if signal not in machine.signals:
+        raise DescriptionError(line, "unknown signal '%s'" % signal)
+    if op not in OPERATORS:
+        raise DescriptionError(line, "unknown operator '%s'" % op)
+    return Guard(signal, op, parse_value(line, machine, value))
+
+
+def parse_transition(line, machine, state, tokens):
+    if len(tokens) < 4 or tokens[1] != "when":
+        raise DescriptionError(line, "expected '-> <state> when <guard>'")
+    target = tokens[0]
+
+    options = []
+    while tokens and OPTION.match(tokens[-1]):
+        options.insert(0, tokens.pop())
+    condition = tokens[2:]
+
+    combination = "single"
+    guards = [condition]
+    for joiner in ("and", "or"):
+        if joiner in condition:
+            split = condition.index(joiner)
+            combination = joiner
+            guards = [condition[:split], condition[split + 1:]]
+    transition = Transition(line, state.name, target,
+                            [parse_guard(line, machine, g) for g in guards], combination)
+
+    for option in options:
+        key, value = OPTION.match(option).groups()
+        if key == "hysteresis":
+            transition.hysteresis = parse_value(line, machine, value)
+        elif key == "dwell":
+            transition.dwell = parse_dwell(line, machine, value)
+        elif key == "do":
+            transition.func = value
+        else:
+            raise DescriptionError(line, "'%s' is a state option" % key)
+    return transition
+
+
+def parse(text):
+    """Parses a machine description."""
+    machine = Machine()
+    state = None
+
+    for number, raw in enumerate(text.splitlines(), 1):
+        tokens = raw.split("#", 1)[0].split()
+        comment = raw.split("#", 1)[1].strip() if "#" in raw else None
+        if not tokens:
+            continue
+        keyword, arguments = tokens[0], tokens[1:]
+
+        if keyword == "machine" and len(arguments) == 1:
+            machine.name = arguments[0]
+        elif keyword == "signals" and arguments:
+            machine.signals = arguments
+        elif keyword == "define" and len(arguments) == 2:
+            if NAME.match(arguments[0]) is None:
+                raise DescriptionError(number, "'%s' is not a C macro name" % arguments[0])
+            if arguments[0] in machine.defines:
+                raise DescriptionError(number, "'%s' is defined twice" % arguments[0])
+            machine.defines[arguments[0]] = (parse_int(number, arguments[1]), comment)
+        elif keyword == "hysteresis" and len(arguments) == 1:
+            machine.hysteresis = parse_value(number, machine, arguments[0])
+        elif keyword == "state" and arguments:
+            if machine.state(arguments[0]) is not None:
+                raise DescriptionError(number, "state '%s' is defined twice" % arguments[0])
+            state = State(number, arguments[0], len(machine.states))
+            for option in arguments[1:]:
+                match = OPTION.match(option)
+                if match is None or match.group(1) not in ("parent", "enter", "exit", "tick"):
+                    raise DescriptionError(number, "unknown state option '%s'" % option)
+                setattr(state, match.group(1), match.group(2))
+            machine.states.append(state)
+        elif keyword == "->":
+            if state is None:
+                raise DescriptionError(number, "transition outside of a state")
+            state.transitions.append(parse_transition(number, machine, state, arguments))
+        else:
+            raise DescriptionError(number, "cannot read '%s'" % raw.strip())
+
+    if machine.name is None or not machine.signals or not machine.states:
+        raise DescriptionError(0, "machine, signals and a state are required")
+    return machine
+
+
+def validate(machine):
+    """Checks a machine, returns the errors and warnings found."""
+    errors = []
+    warnings = []
+
+    if len(machine.states) > MAX_STATES:
+        errors.append("%d states, the engine takes at most %d" % (len(machine.states), MAX_STATES))
+
+    # References and the hierarchy
+    for state in machine.states:
+        if state.parent is not None and machine.state(state.parent) is None:
+            errors.append("line %d: unknown parent '%s'" % (state.line, state.parent))
+        for transition in state.transitions:
+            if machine.state(transition.target) is None:
+                errors.append("line %d: unknown state '%s'" % (transition.line, transition.target))
+    if errors:
+        return errors, warnings
+    for state in machine.states:
+        seen = [state.name]
+        parent = state.parent
+        while parent is not None:
+            if parent in seen or len(seen) >= MAX_DEPTH:
+                errors.append("line %d: '%s' nests too deeply or is its own ancestor"
+                              % (state.line, state.name))
+                break
+            seen.append(parent)
+            parent = machine.state(parent).parent
+    if errors:
+        return errors, warnings
+
+    # Reachability, entering a state makes its ancestors active as well
+    active = set()
+    pending = [machine.states[0]]
+    while pending:
+        state = pending.pop()
+        for member in machine.chain(state):
+            if member.name not in active:
+                active.add(member.name)
+                pending.append(member)
+        for transition in machine.transitions(state):
+            target = machine.state(transition.target)
+            if target.name not in active:
+                pending.append(target)
+    for state in machine.states:
+        if state.name not in active:
+            errors.append("line %d: '%s' can never be reached" % (state.line, state.name))
+
+    # Determinism, the first transition that holds wins
+    for state in machine.states:
+        transitions = machine.transitions(state)
+        boxes = [t.boxes() for t in transitions]
+        for j, later in enumerate(transitions):
+            live = [b for b in boxes[j]
+                    if not any(contains(a, b) for i in range(j) for a in boxes[i])]
+            if not live:
+                errors.append("line %d: in %s, '%s' can never fire"
+                              % (later.line, state.name, later))
+                continue
+            for i in range(j):
+                if transitions[i].target == later.target:
+                    continue
+                if any(intersect(a, b) for a in boxes[i] for b in boxes[j]):
+                    warnings.append("line %d: in %s, '%s' and '%s' can hold at once, "
+                                    "the first wins" % (later.line, state.name,
+                                                        transitions[i], later))
+
+    # Hysteresis consistency
+    for state in machine.states:
+        for transition in state.transitions:
+            hysteresis = machine.hysteresis_of(transition)
+            guard = transition.guards[0]
+            if hysteresis == 0:
+                continue
+            if guard.op not in THRESHOLD_OPERATORS:
+                if transition.hysteresis is not None:
+                    warnings.append("line %d: hysteresis has no effect on '%s'"
+                                    % (transition.line, guard))
+                continue
+            target = machine.state(transition.target)
+            upward = guard.op in (">", ">=")
+            for back in machine.transitions(target):
+                if back is transition:
+                    continue
+                back_guard = back.guards[0]
+                if back_guard.signal != guard.signal or back_guard.op not in THRESHOLD_OPERATORS:
+                    continue
+                if back.target == state.name:
+                    if (back_guard.op in (">", ">=")) == upward:
+                        warnings.append("line %d: '%s' returns in the same direction as "
+                                        "line %d" % (back.line, back, transition.line))
+                    elif back_guard.threshold != guard.threshold:
+                        warnings.append("line %d: band edge %d differs from %d on line %d, "
+                                        "the hysteresis is released at the taken edge"
+                                        % (back.line, back_guard.threshold,
+                                           guard.threshold, transition.line))
+                    if machine.hysteresis_of(back) != hysteresis:
+                        warnings.append("line %d: hysteresis %d differs from %d on line %d, "
+                                        "both directions should match"
+                                        % (back.line, machine.hysteresis_of(back),
+                                           hysteresis, transition.line))
+                elif abs(back_guard.threshold - guard.threshold) <= hysteresis:
+                    errors.append("line %d: hysteresis %d is wider than the band of %s, "
+                                  "which is left again at %d on line %d"
+                                  % (transition.line, hysteresis, target.name,
+                                     back_guard.threshold, back.line))
+    return errors, warnings
+
+
+def is_lut_eligible(machine):
+    """Mirrors the checks of compile_band_lut() in state_machine.c."""
+    if machine.is_hierarchical or len(machine.states) > LUT_MAX_STATES:
+        return False
+    transitions = [t for s in machine.states for t in s.transitions]
+    if not transitions or any(t.guards[0].op not in THRESHOLD_OPERATORS for t in transitions):
+        return False
+    if len(set(t.guards[0].signal for t in transitions)) != 1:
+        return False
+    boundaries = set()
+    for transition in transitions:
+        guard = transition.guards[0]
+        for adjustment in (0, machine.hysteresis_of(transition)):
+            if guard.op in ("<", ">="):
+                boundaries.add(guard.threshold + (adjustment if guard.op == ">=" else -adjustment))
+            elif guard.op == "<=":
+                boundaries.add(guard.threshold - adjustment + 1)
+            else:
+                boundaries.add(guard.threshold + adjustment + 1)
+    base, top = min(boundaries), max(boundaries)
+    width = 0
+    for boundary in boundaries:
+        a, b = width, boundary - base
+        while b:
+            a, b = b, a % b
+        width = a
+    return (top - base) // max(width, 1) + 2 <= LUT_MAX_BANDS
+
+
+def report(machine, out):
+    """Writes the worst case work per update."""
+    out.write("%s: %d states, %d signals\n" % (machine.name, len(machine.states),
+                                              len(machine.signals)))
+    worst_transitions = worst_guards = 0
+    for state in machine.states:
+        transitions = machine.transitions(state)
+        guards = sum(len(t.guards) for t in transitions)
+        worst_transitions = max(worst_transitions, len(transitions))
+        worst_guards = max(worst_guards, guards)
+        out.write("  %-24s %d transitions, %d guards\n" % (state.name, len(transitions), guards))
+    out.write("worst case per update: %d transitions, %d guards\n"
+              % (worst_transitions, worst_guards))
+    out.write("band lookup table: %s\n" % ("eligible" if is_lut_eligible(machine) else "falls back"))
+    flash = sum(STATE_BYTES + TRANSITION_BYTES * (len(s.transitions) + 1) for s in machine.states)
+    out.write("state tables: %d bytes of flash\n" % flash)
+
+
+def c_value(value):
+    return value.text if isinstance(value, Number) else str(value)
+
+
+def c_guard(guard):
+    return "STATE_MACHINE_GUARD(%s, %s, %s)" % (guard.signal, OPERATORS[guard.op],
+                                                c_value(guard.threshold))
+
+
+def c_dwell(dwell):
+    if dwell is None:
+        return "STATE_MACHINE_NO_DWELL"
+    unit, value = dwell
+    return "STATE_MACHINE_DWELL_%s(%s)" % ("SAMPLES" if unit == "samples" else "US",
+                                          c_value(value))
+
+
+def c_hysteresis(hysteresis):
+    """Writes a transition's hysteresis, None deferring to the machine's."""
+    if hysteresis is None:
+        return "STATE_MACHINE_CONFIG_HYSTERESIS"
+    return "HYSTERESIS_DISABLED" if hysteresis == 0 else c_value(hysteresis)
+
+
+def c_comparison(machine, transition, guard):
+    """Writes a guard as an inline comparison, with the engine's hysteresis."""
+    op = guard.op
+    hysteresis = machine.hysteresis_of(transition)
+    signal = "signals[%s]" % guard.signal
+    threshold = c_value(guard.threshold)
+    if hysteresis == 0 or op not in THRESHOLD_OPERATORS:
+        return "%s %s %s" % (signal, op, threshold)
+    adjusted = "%s %s %s" % (threshold, "+" if op in (">", ">=") else "-", c_value(hysteresis))
+    return "%s %s ((returning_state == %s && hysteresis_signal == %s) ? (%s) : %s)" % (
+        signal, op, transition.target, guard.signal, adjusted, threshold)
+
+
+def include_guard(path):
+    return re.sub(r"\W", "_", path.replace("\\", "/").split("/")[-1]).upper()
+
+
+def functions_of(machine):
+    """Returns every hook and transition function, each once."""
+    functions = []
+    for state in machine.states:
+        functions += [state.enter, state.exit, state.tick]
+        functions += [t.func for t in state.transitions]
+    return [f for i, f in enumerate(functions) if f and f not in functions[:i]]
+
+
+def emit_header(machine, source, header):
+    """Writes the header declaring the machine's constants, states and configuration."""
+    name = machine.name
+    guard = include_guard(header)
+    lines = [
+        "/* Generated by Tools/state_machine_compiler.py from %s, do not edit */" % source,
+        "#ifndef %s" % guard,
+        "#define %s" % guard,
+        "",
+        "#include \"state_machine.h\"",
+        "",
+        "#ifdef __cplusplus",
+        "extern \"C\" {",
+        "#endif",
+        "",
+    ]
+    if machine.defines:
+        lines += ["/* Constants */"]
+        for define, (value, comment) in machine.defines.items():
+            if comment:
+                lines += ["/* %s */" % comment]
+            lines += ["#define %s %d" % (define, value)]
+        lines += [""]
+
+    lines += ["/* States */", "typedef enum", "{"]
+    lines += ["\t%s%s," % (s.name, " = 0" if s.index == 0 else "") for s in machine.states]
+    lines += ["\t%s_END_STATE" % name.upper(), "} %s_state_t;" % name, "",
+              "/* Signals */", "typedef enum", "{"]
+    lines += ["\t%s%s," % (s, " = 0" if i == 0 else "") for i, s in enumerate(machine.signals)]
+    lines[-1] = lines[-1].rstrip(",")
+    lines += ["} %s_signal_t;" % name, ""]
+
+    functions = functions_of(machine)
+    if functions:
+        lines += ["/* State Machine Functions */"]
+        lines += ["void %s();" % f for f in functions]
+        lines += [""]
+
+    lines += ["/** Final State Machine Configuration",
+              " *",
+              " * This is passed into the state machine init function.",
+              " */",
+              "extern const state_machine_config_t %s_config;" % name,
+              "",
+              "#ifdef __cplusplus",
+              "}",
+              "#endif",
+              "",
+              "#endif",
+              ""]
+    return "\r\n".join(lines)
+
+
+def emit_source(machine, emit_switch, source, header):
+    """Writes the state tables and configuration, with a switch dispatch if asked."""
+    name = machine.name
+    lines = [
+        "/* Generated by Tools/state_machine_compiler.py from %s, do not edit */" % source,
+        "#include \"%s\"" % header.replace("\\", "/").split("/")[-1],
+        "",
+        "/* States */",
+    ]
+    for state in machine.states:
+        parent = machine.state(state.parent)
+        lines += [
+            "static const state_machine_state_t %s =" % state.variable,
+            "{",
+            "\t.state = %s," % state.name,
+            "\t.parent = %s," % ("&%s" % parent.variable if parent else "NULL"),
+            "\t.on_enter = %s," % (state.enter or "NULL"),
+            "\t.on_exit = %s," % (state.exit or "NULL"),
+            "\t.on_tick = %s," % (state.tick or "NULL"),
+            "\t.transitions =",
+            "\t{",
+        ]
+        for transition in state.transitions:
+            guards = [c_guard(g) for g in transition.guards]
+            if len(guards) == 1:
+                guards.append("STATE_MACHINE_NO_GUARD")
+            if len(transition.guards) == 1:
+                lines += ["\t\t{{%s, %s}," % tuple(guards)]
+            else:
+                lines += ["\t\t{{%s," % guards[0], "\t\t\t%s}," % guards[1]]
+            lines += [
+                "\t\t\tGUARD_%s, %s, %s," % (transition.combination.upper(), transition.target,
+                                            transition.func or "STATE_MACHINE_NO_FUNC"),
+                "\t\t\t%s, %s}," % (c_hysteresis(transition.hysteresis),
+                                    c_dwell(transition.dwell)),
+            ]
+        lines += ["\t\tSTATE_MACHINE_TRANSITION_TERMINATOR_DECL", "\t}", "};", ""]
+
+    lines += ["/* State Machine State Pointer-Array */",
+              "static const state_machine_state_t* const %s_states[%s_END_STATE] =" % (
+                  name, name.upper()),
+              "{"]
+    lines += ["\t&%s," % s.variable for s in machine.states]
+    lines[-1] = lines[-1].rstrip(",")
+    lines += ["};", ""]
+
+    if machine.is_hierarchical:
+        lines += ["/* Ancestor chains compiled by initialize_state_machine() */",
+                  "static state_machine_hierarchy_t %s_hierarchy;" % name, ""]
+    elif not emit_switch and is_lut_eligible(machine):
+        lines += ["#if STATE_MACHINE_BAND_LUT",
+                  "/* Band lookup table compiled from the states above */",
+                  "static state_machine_band_lut_t %s_band_lut;" % name, "#endif", ""]
+
+    if emit_switch:
+        lines += [
+            "/* Finds the first transition that holds, every guard compared inline */",
+            "static const state_machine_transition_t* %s_dispatch(" % name,
+            "\tstate_machine_state_enum_t state,",
+            "\tstate_machine_state_enum_t returning_state,",
+            "\tstate_machine_signal_t hysteresis_signal,",
+            "\tconst state_machine_params_t* params",
+            ")",
+            "{",
+            "\tconst int32_t* signals = params->signals;",
+            "",
+            "\tswitch(state)",
+            "\t{",
+        ]
+        for state in machine.states:
+            lines += ["\tcase %s:" % state.name]
+            for member in machine.chain(state):
+                for index, transition in enumerate(member.transitions):
+                    comparisons = [c_comparison(machine, transition, g) for g in transition.guards]
+                    joiner = " && " if transition.combination == "and" else " || "
+                    if len(comparisons) > 1:
+                        condition = "(%s)" % joiner.join("(%s)" % c for c in comparisons)
+                    else:
+                        condition = "(%s)" % comparisons[0]
+                    lines += ["\t\tif %s" % condition,
+                              "\t\t\treturn &%s.transitions[%d];" % (member.variable, index)]
+            lines += ["\t\treturn NULL;"]
+        lines += ["\tdefault:", "\t\treturn NULL;", "\t}", "}", ""]
+
+    lines += ["/* Final State Machine Configuration */",
+              "const state_machine_config_t %s_config =" % name,
+              "{",
+              "\t.hysteresis = %s," % c_value(machine.hysteresis),
+              "\t.state_machine = %s_states," % name]
+    if machine.is_hierarchical:
+        lines += ["\t.hierarchy = &%s_hierarchy," % name]
+    elif not emit_switch and is_lut_eligible(machine):
+        lines += ["#if STATE_MACHINE_BAND_LUT", "\t.band_lut = &%s_band_lut," % name, "#endif"]
+    if emit_switch:
+        lines += ["\t.dispatch = %s_dispatch," % name]
+    lines += ["};", ""]
+    return "\r\n".join(lines)
+
+
+def cpp_transition(transition):
+    """Writes a transition as state_machine.hpp's template, leaving out trailing defaults."""
+    def cpp_guard(guard):
+        return "guard<%s, %s, %s>" % (guard.signal, OPERATORS[guard.op], c_value(guard.threshold))
+
+    arguments = [
+        transition.target,
+        cpp_guard(transition.guards[0]),
+        "GUARD_%s" % transition.combination.upper(),
+        cpp_guard(transition.guards[1]) if len(transition.guards) > 1 else "no_guard",
+        "hook<%s>" % transition.func if transition.func else "no_hook",
+        c_hysteresis(transition.hysteresis),
+        c_dwell(transition.dwell),
+    ]
+    defaults = [None, None, "GUARD_SINGLE", "no_guard", "no_hook",
+                "STATE_MACHINE_CONFIG_HYSTERESIS", "STATE_MACHINE_NO_DWELL"]
+    while arguments[-1] == defaults[len(arguments) - 1]:
+        arguments.pop()
+    text = "\ttransition<%s" % ", ".join(arguments[:2])
+    for line in (arguments[2:4], arguments[4:]):
+        if line:
+            text += ",\r\n\t\t%s" % ", ".join(line)
+    return text + ">"
+
+
+def emit_cpp(machine, source, header, cpp):
+    """Writes the machine as a type for the compile-time engine in state_machine.hpp."""
+    name = machine.name
+    guard = include_guard(cpp)
+    lines = [
+        "/* Generated by Tools/state_machine_compiler.py from %s, do not edit */" % source,
+        "#ifndef %s" % guard,
+        "#define %s" % guard,
+        "",
+        "#include \"state_machine.hpp\"",
+        "#include \"%s\"" % header.replace("\\", "/").split("/")[-1],
+        "",
+        "/** Compile-time %s state machine" % name,
+        " *",
+        " * The same states, guards and hooks as %s_config, for state_machine.hpp." % name,
+        " */",
+        "namespace %s" % name,
+        "{",
+        "",
+        "using namespace state_machine;",
+        "",
+        "/* States */",
+    ]
+    for state in machine.states:
+        hooks = ["hook<%s>" % f if f else "no_hook" for f in (state.enter, state.exit, state.tick)]
+        lines += ["using %s = state<%s," % (state.variable, state.name), "\t%s," % ", ".join(hooks)]
+        lines += [",\r\n".join(cpp_transition(t) for t in state.transitions), ">;", ""]
+
+    lines += ["/* Final State Machine Type */",
+              "using machine_type = machine<%s," % c_value(machine.hysteresis)]
+    lines += ["\t%s," % s.variable for s in machine.states]
+    lines[-1] = lines[-1].rstrip(",")
+    lines += [">;", "", "}", "", "#endif", ""]
+    return "\r\n".join(lines)
+
+
+def write_output(path, text, check):
+    """Writes a generated file, or with check only compares it, returns if it matched."""
+    if check:
+        try:
+            with open(path, newline="") as f:
+                if f.read() == text:
+                    return True
+        except OSError:
+            pass
+        sys.stderr.write("%s: out of date, rerun without --check\n" % path)
+        return False
+    with open(path, "w", newline="") as f:
+        f.write(text)
+    return True
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("description", help="machine description to compile")
+    parser.add_argument("--emit", choices=("tables", "switch"),
+                        help="write the tables, or the tables with a switch dispatch")
+    parser.add_argument("--header", help="header to write, stdout if not given")
+    parser.add_argument("--source", help="source to write, stdout if not given")
+    parser.add_argument("--cpp", help="also write the machine for state_machine.hpp")
+    parser.add_argument("--check", action="store_true",
+                        help="compare the outputs with the files instead of writing them")
+    parser.add_argument("--strict", action="store_true", help="treat warnings as errors")
+    args = parser.parse_args()
+
+    with open(args.description) as f:
+        try:
+            machine = parse(f.read())
+        except DescriptionError as error:
+            sys.stderr.write("%s:%s\n" % (args.description, error))
+            return 1
+
+    errors, warnings = validate(machine)
+    if args.cpp and machine.is_hierarchical:
+        errors.append("state_machine.hpp has no hierarchical states, leave out --cpp")
+    if args.cpp and not (args.emit and args.header):
+        errors.append("--cpp includes the header, give --emit and --header too")
+    for warning in warnings:
+        sys.stderr.write("%s: warning: %s\n" % (args.description, warning))
+    for error in errors:
+        sys.stderr.write("%s: error: %s\n" % (args.description, error))
+    if errors or (args.strict and warnings):
+        return 1
+
+    to_stdout = args.emit and not (args.header and args.source)
+    if not args.check:
+        report(machine, sys.stderr if to_stdout else sys.stdout)
+
+    if args.emit:
+        source = args.description.replace("\\", "/")
+        header_path = args.header or "%s_tables.h" % machine.name
+        outputs = [
+            (args.header, emit_header(machine, source, header_path)),
+            (args.source, emit_source(machine, args.emit == "switch", source, header_path)),
+        ]
+        if args.cpp:
+            outputs.append((args.cpp, emit_cpp(machine, source, header_path, args.cpp)))
+        matched = True
+        for path, text in outputs:
+            if path:
+                matched = write_output(path, text, args.check) and matched
+            else:
+                sys.stdout.write(text)
+        if not matched:
+            return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())